@@ -3,10 +3,13 @@ BlockPointGrid.cpp
 */
 
 #include <math.h>
+#include <atomic>
+#include <iterator>
+#include <tuple>
+#include <utility>
 
 #include "BlockPointGrid.h"
-#include "operators.h"
-#include "MeshMaker.h"
+#include "Operators.h"
 
 void BlockPointGrid::setIndexVectorsAndMaximums() {
 
@@ -37,7 +40,7 @@ void BlockPointGrid::setIndexVectorsAndMaximums() {
 
 				// Feels a little awkward doing this here, but it so happens that this should work.  That is, we will calculate the maximum
 				// blockage and maximum light vector here since we are already looping through the correct range of grid units
-				// What we are adding to maximumBlockage here is the same as blockageStrength times grid[xI][yI][zI].density, since
+				// What we are adding to maximumBlockage here is the same as blockageStrength times the density of the unit, since
 				// we are finding the maximum, all densities are 1. so no need to multiply
 
 				double blockageStrength = 1. - (trueVectToUnit.getMag() / detectionRange);
@@ -58,46 +61,492 @@ void BlockPointGrid::setIndexVectorsAndMaximums() {
 	maximumLightVector.x = trunc4(maximumLightVector.x);
 	maximumLightVector.y = trunc4(maximumLightVector.y);
 	maximumLightVector.z = trunc4(maximumLightVector.z);
+	maximumLightMagnitude = maximumLightVector.getMag();
 
 	// Resize all index vectors' trueVects to account for intensity
 	for (auto &v : indexVectorsToUnitsInCone) 
 		v.blockageVect.resize(v.blockageVect.getMag() * maximumLightVector.getMag() * intensity);
+
+	if (exactAccumulation)
+		this->quantizeWeights();
 }
 
-void BlockPointGrid::initiateGrid() {
+void BlockPointGrid::quantizeWeights() {
+
+	// No unit's blockage can exceed maximumBlockage, nor can any component of its light exceed maximumLightMagnitude plus the
+	// light weights of the whole cone, which add up to maximumBlockage * maximumLightMagnitude * intensity.  Densities change
+	// by at most 1 per unit.  So with bound below 2^exponent, sums of multiples of weightQuantum * 2^-densityQuantumBits stay
+	// below 2^51 of them, within the 53 bits of a double with 2 to spare
+	double bound = std::max(maximumBlockage, maximumLightMagnitude * (1. + maximumBlockage * intensity));
+	int exponent;
+	std::frexp(bound, &exponent);
+	weightQuantum = std::ldexp(1., exponent + 2 + densityQuantumBits - 53);
+
+	auto quantize = [this](double weight) { return std::round(weight / weightQuantum) * weightQuantum; };
+
+	maximumBlockage = 0.;
+	for (auto &v : indexVectorsToUnitsInCone) {
+
+		v.blockageVect = CVect(quantize(v.blockageVect.getX()), quantize(v.blockageVect.getY()), quantize(v.blockageVect.getZ()));
+		v.blockageStrength = quantize(v.blockageStrength);
+		maximumBlockage += v.blockageStrength;
+	}
+
+	maximumLightVector = Point(quantize(maximumLightVector.x), quantize(maximumLightVector.y), quantize(maximumLightVector.z));
+	maximumLightMagnitude = maximumLightVector.getMag();
+}
+
+void BlockPointGrid::compileCone(const std::vector<IndexVector> &indexVects, int yElements, int zElements, Cone &cone) {
+
+	cone = Cone();
+
+	for (const auto &indexVect : indexVects) {
+
+		int entry = cone.strength.size();
+
+		// indexVects is filled with z as the innermost loop, so a run continues as long as x and y stay the same and z increases
+		// by one
+		if (!cone.runs.empty() && cone.runs.back().x == indexVect.x && cone.runs.back().y == indexVect.y &&
+			cone.runs.back().zStart + cone.runs.back().length == indexVect.z) {
+
+			++cone.runs.back().length;
+		}
+		else {
+
+			int offset = (indexVect.x * yElements + indexVect.y) * zElements + indexVect.z;
+			cone.runs.push_back(ConeRun(indexVect.x, indexVect.y, indexVect.z, offset, entry));
+		}
+
+		cone.lightX.push_back(indexVect.blockageVect.getX());
+		cone.lightY.push_back(indexVect.blockageVect.getY());
+		cone.lightZ.push_back(indexVect.blockageVect.getZ());
+		cone.strength.push_back(indexVect.blockageStrength);
+
+		cone.minX = std::min(cone.minX, indexVect.x);
+		cone.maxX = std::max(cone.maxX, indexVect.x);
+		cone.minY = std::min(cone.minY, indexVect.y);
+		cone.maxY = std::max(cone.maxY, indexVect.y);
+		cone.minZ = std::min(cone.minZ, indexVect.z);
+		cone.maxZ = std::max(cone.maxZ, indexVect.z);
+	}
+}
+
+void BlockPointGrid::compileCones(int levelCount) {
+
+	// Existing levels keep the changes they hold, so the cones can be recompiled after a parameter changes
+	coarseLevels.resize(levelCount);
+
+	if (levelCount == 0) {
+
+		compileCone(indexVectorsToUnitsInCone, yElements, zElements, cone);
+		this->compileShiftStencils(indexVectorsToUnitsInCone);
+		return;
+	}
+
+	// Distances are measured in units of the full resolution grid, as in setIndexVectorsAndMaximums()
+	int maxIndexDiff = detectionRange / unitSize;
+	double nearRange = maxIndexDiff / double(1 << levelCount);
+
+	std::vector<IndexVector> nearIndexVects;
+	for (const auto &indexVect : indexVectorsToUnitsInCone) {
+
+		if (std::sqrt(indexVect.x * indexVect.x + indexVect.y * indexVect.y + indexVect.z * indexVect.z) < nearRange)
+			nearIndexVects.push_back(indexVect);
+	}
 
-	double xCoord = 0. - halfGridXSize + (unitSize*.5);
+	compileCone(nearIndexVects, yElements, zElements, cone);
+	this->compileShiftStencils(nearIndexVects);
 
-	for (int xI = 0; xI < xElements; ++xI) {
+	for (int shift = 1; shift <= levelCount; ++shift) {
 
-		double yCoord = unitSize / 2.;
+		CoarseLevel &level = coarseLevels[shift - 1];
+		level.shift = shift;
+		level.xElements = (xElements + (1 << shift) - 1) >> shift;
+		level.yElements = (yElements + (1 << shift) - 1) >> shift;
+		level.zElements = (zElements + (1 << shift) - 1) >> shift;
 
-		grid.push_back(std::vector< std::vector<Unit> >());
+		// The level takes the index vectors whose distance, scaled back up to full resolution units, is within its shell
+		double innerRange = nearRange * (1 << (shift - 1));
+		double outerRange = std::min(nearRange * (1 << shift), double(maxIndexDiff));
+		int bound = int(std::ceil(outerRange / (1 << shift)));
 
-		for (int yI = 0; yI < yElements; ++yI) {
+		std::vector<IndexVector> levelIndexVects;
+		for (int xIDist = -bound; xIDist <= bound; ++xIDist) {
+			for (int yIDist = -bound; yIDist < 0; ++yIDist) {
+				for (int zIDist = -bound; zIDist <= bound; ++zIDist) {
 
-			double zCoord = 0. - halfGridZSize + (unitSize*.5);
+					double indexDistanceToUnit = std::sqrt(xIDist * xIDist + yIDist * yIDist + zIDist * zIDist) * (1 << shift);
 
-			grid.back().push_back(std::vector<Unit>());
+					if (indexDistanceToUnit < innerRange || indexDistanceToUnit >= outerRange)
+						continue;
 
-			for (int zI = 0; zI < zElements; ++zI) {
+					// The same weights setIndexVectorsAndMaximums() gives a unit at this distance and direction
+					CVect trueVectToUnit = CVect(xIDist, yIDist, zIDist).resized(indexDistanceToUnit * unitSize);
 
-				grid.back().back().push_back(Unit(xCoord, yCoord, zCoord, maximumLightVector.x, maximumLightVector.y, maximumLightVector.z));
+					if (findAngBetween(trueVectToUnit, CVect(0., -1., 0., 1.)) > coneRangeAngle)
+						continue;
 
-				zCoord += unitSize;
+					double blockageStrength = trunc4(1. - (trueVectToUnit.getMag() / detectionRange));
+					CVect blockageVector = trueVectToUnit.resized(blockageStrength * maximumLightMagnitude * intensity);
+
+					levelIndexVects.push_back(IndexVector(xIDist, yIDist, zIDist, blockageVector, blockageStrength));
+				}
 			}
+		}
+
+		compileCone(levelIndexVects, level.yElements, level.zElements, level.cone);
+
+		std::size_t totalUnits = std::size_t(level.xElements) * level.yElements * level.zElements;
+		if (level.blockage.size() != totalUnits) {
+
+			level.blockage.assign(totalUnits, 0.);
+			level.lightX.assign(totalUnits, 0.);
+			level.lightY.assign(totalUnits, 0.);
+			level.lightZ.assign(totalUnits, 0.);
+		}
+	}
+}
+
+void BlockPointGrid::compileShiftStencils(const std::vector<IndexVector> &indexVects) {
+
+	shiftStencils.clear();
+	if (!useShiftStencils)
+		return;
+
+	// The index vectors by offset, over the cone's bounds plus a unit on every side, so that shifted offsets can be looked up
+	// without checking them
+	int xSpan = cone.maxX - cone.minX + 3;
+	int ySpan = cone.maxY - cone.minY + 3;
+	int zSpan = cone.maxZ - cone.minZ + 3;
+	std::vector<const IndexVector*> byOffset(std::size_t(xSpan) * ySpan * zSpan, nullptr);
+
+	auto offsetIndex = [&](int x, int y, int z) {
+
+		return ((x - cone.minX + 1) * ySpan + (y - cone.minY + 1)) * zSpan + (z - cone.minZ + 1);
+	};
+
+	for (const auto &indexVect : indexVects)
+		byOffset[offsetIndex(indexVect.x, indexVect.y, indexVect.z)] = &indexVect;
+
+	// Whether a difference between two weights is more than rounding.  With exact accumulation both weights are multiples of
+	// weightQuantum, so their difference is exact and is either 0 or at least one quantum.  Otherwise, a difference within a few
+	// ulps of the weights is what subtracting one cone and adding the other would leave anyway
+	auto significant = [this](double difference, double oldWeight, double newWeight) {
 
-			yCoord += unitSize;
+		double tolerance = exactAccumulation ? weightQuantum / 2. :
+			4. * std::numeric_limits<double>::epsilon() * std::max(std::abs(oldWeight), std::abs(newWeight));
+
+		return std::abs(difference) > tolerance;
+	};
+
+	// Each run costs about as much as 20 entries to apply, mostly in reaching its units.  Measured with runs of 1 to 32 units
+	double runCost = 20.;
+	double twoConesCost = 2. * (double(cone.strength.size()) + runCost * double(cone.runs.size()));
+
+	shiftStencils.resize(27);
+	for (int dx = -1; dx <= 1; ++dx) {
+		for (int dy = -1; dy <= 1; ++dy) {
+			for (int dz = -1; dz <= 1; ++dz) {
+
+				int stencil = shiftStencilIndex(dx, dy, dz);
+				if (stencil < 0)
+					continue;
+
+				// Offsets are from the old unit.  The unit at (x, y, z) from the old unit is at (x - dx, y - dy, z - dz) from the new
+				// one.  Filled with z as the innermost loop, as compileCone() needs
+				std::vector<IndexVector> differences;
+				for (int x = cone.minX - 1; x <= cone.maxX + 1; ++x) {
+					for (int y = cone.minY - 1; y <= cone.maxY + 1; ++y) {
+						for (int z = cone.minZ - 1; z <= cone.maxZ + 1; ++z) {
+
+							const IndexVector *oldVect = byOffset[offsetIndex(x, y, z)];
+							const IndexVector *newVect = nullptr;
+							if (x - dx >= cone.minX - 1 && x - dx <= cone.maxX + 1 && y - dy >= cone.minY - 1 && y - dy <= cone.maxY + 1 &&
+								z - dz >= cone.minZ - 1 && z - dz <= cone.maxZ + 1)
+								newVect = byOffset[offsetIndex(x - dx, y - dy, z - dz)];
+
+							if (!oldVect && !newVect)
+								continue;
+
+							CVect oldLight = oldVect ? oldVect->blockageVect : CVect(0., 0., 0., 0.);
+							CVect newLight = newVect ? newVect->blockageVect : CVect(0., 0., 0., 0.);
+							double oldStrength = oldVect ? oldVect->blockageStrength : 0.;
+							double newStrength = newVect ? newVect->blockageStrength : 0.;
+
+							double lightX = newLight.getX() - oldLight.getX();
+							double lightY = newLight.getY() - oldLight.getY();
+							double lightZ = newLight.getZ() - oldLight.getZ();
+							double strength = newStrength - oldStrength;
+
+							if (!significant(lightX, oldLight.getX(), newLight.getX()) && !significant(lightY, oldLight.getY(), newLight.getY()) &&
+								!significant(lightZ, oldLight.getZ(), newLight.getZ()) && !significant(strength, oldStrength, newStrength))
+								continue;
+
+							differences.push_back(IndexVector(x, y, z, CVect(lightX, lightY, lightZ, 0.), strength));
+						}
+					}
+				}
+
+				compileCone(differences, yElements, zElements, shiftStencils[stencil]);
+
+				// A stencil that costs as much as the two cones it replaces is left empty, and moves by this shift apply both cones
+				Cone &compiled = shiftStencils[stencil];
+				if (double(compiled.strength.size()) + runCost * double(compiled.runs.size()) >= twoConesCost)
+					compiled = Cone();
+			}
 		}
+	}
+}
+
+void BlockPointGrid::initiateGrid() {
+
+	if (sparseStorage) {
+
+		sparseRows.resize(std::size_t(xElements) * yElements);
+		sparseCacheRows.resize(sparseRows.size());
+		sparsePackedRows.resize(sparseRows.size());
+		return;
+	}
+
+	std::size_t totalUnits = std::size_t(xElements) * yElements * zElements;
+
+	density.assign(totalUnits, 0.);
+
+	if (floatStorage) {
+
+		std::vector<double>().swap(blockage);
+		std::vector<double>().swap(lightX);
+		std::vector<double>().swap(lightY);
+		std::vector<double>().swap(lightZ);
+		floatBlockage.assign(totalUnits, 0.f);
+		floatLightX.assign(totalUnits, float(maximumLightVector.x));
+		floatLightY.assign(totalUnits, float(maximumLightVector.y));
+		floatLightZ.assign(totalUnits, float(maximumLightVector.z));
+	}
+	else {
+
+		std::vector<float>().swap(floatBlockage);
+		std::vector<float>().swap(floatLightX);
+		std::vector<float>().swap(floatLightY);
+		std::vector<float>().swap(floatLightZ);
+		blockage.assign(totalUnits, 0.);
+		lightX.assign(totalUnits, maximumLightVector.x);
+		lightY.assign(totalUnits, maximumLightVector.y);
+		lightZ.assign(totalUnits, maximumLightVector.z);
+	}
+
+	this->reallocateQueryCache();
+}
+
+void BlockPointGrid::reallocateQueryCache() {
+
+	if (sparseStorage) {
+
+		for (auto &row : sparseCacheRows)
+			row.reset();
+
+		for (auto &row : sparsePackedRows)
+			row.reset();
+
+		return;
+	}
+
+	// Swapping with an empty vector frees the memory, which clear() does not
+	std::vector<double>().swap(cachedDirectionX);
+	std::vector<double>().swap(cachedDirectionY);
+	std::vector<double>().swap(cachedDirectionZ);
+	std::vector<double>().swap(cachedBlockage);
+	std::vector<PackedQuery>().swap(packedQueries);
+}
+
+void BlockPointGrid::allocateDenseQueryCache() {
+
+	if (sparseStorage || !cachedBlockage.empty() || !packedQueries.empty())
+		return;
+
+	std::size_t totalUnits = density.size();
+
+	if (packedQueryCache) {
+
+		packedQueries.assign(totalUnits, outdatedPackedQuery());
+		return;
+	}
+
+	cachedDirectionX.assign(totalUnits, 0.);
+	cachedDirectionY.assign(totalUnits, 0.);
+	cachedDirectionZ.assign(totalUnits, 0.);
+	cachedBlockage.assign(totalUnits, outdated());
+}
+
+void BlockPointGrid::allocateSparseQueryCache(std::size_t row) {
+
+	if (!sparseRows[row] || sparseCacheRows[row] || sparsePackedRows[row])
+		return;
+
+	if (packedQueryCache) {
+
+		sparsePackedRows[row].reset(new PackedQuery[zElements]);
+		std::fill(&sparsePackedRows[row][0], &sparsePackedRows[row][zElements], outdatedPackedQuery());
+		return;
+	}
+
+	sparseCacheRows[row].reset(new double[4 * zElements]);
+	std::fill(&sparseCacheRows[row][0], &sparseCacheRows[row][3 * zElements], 0.);
+	std::fill(&sparseCacheRows[row][3 * zElements], &sparseCacheRows[row][4 * zElements], outdated());
+}
+
+void BlockPointGrid::setPackedQueryCache(bool packed) {
+
+	if (packed == packedQueryCache)
+		return;
+
+	packedQueryCache = packed;
+	this->reallocateQueryCache();
+}
+
+void BlockPointGrid::outdateQueries(const UnitRun &units, int count) {
+
+	if (units.packedQueries)
+		std::fill(units.packedQueries, units.packedQueries + count, outdatedPackedQuery());
+	else if (units.cachedBlockage)
+		std::fill(units.cachedBlockage, units.cachedBlockage + count, outdated());
+}
+
+Point BlockPointGrid::unitCenter(int x, int y, int z) const {
+
+	return Point(0. - halfGridXSize + (unitSize * (x + .5)), unitSize * (y + .5), 0. - halfGridZSize + (unitSize * (z + .5)));
+}
+
+Point BlockPointGrid::unitLightDirection(int x, int y, int z) const {
+
+	Point lightDirection = this->storedLightDirection(x, y, z);
+
+	if (deferLightNormalization)
+		lightDirection.resize(maximumLightMagnitude);
+
+	return lightDirection;
+}
+
+Point BlockPointGrid::storedLightDirection(int x, int y, int z) const {
+
+	Point lightDirection;
+
+	if (sparseStorage) {
+
+		const double *row = sparseRows[x * yElements + y].get();
+		if (!row)
+			lightDirection = maximumLightVector;
+		else
+			lightDirection = Point(row[2 * zElements + z], row[3 * zElements + z], row[4 * zElements + z]);
+	}
+	else if (floatStorage) {
+
+		std::size_t i = unitIndex(x, y, z);
+		lightDirection = Point(floatLightX[i], floatLightY[i], floatLightZ[i]);
+	}
+	else {
+
+		std::size_t i = unitIndex(x, y, z);
+		lightDirection = Point(lightX[i], lightY[i], lightZ[i]);
+	}
+
+	for (const auto &level : coarseLevels) {
+
+		int i = level.unitIndex(x >> level.shift, y >> level.shift, z >> level.shift);
+		lightDirection.x += level.lightX[i];
+		lightDirection.y += level.lightY[i];
+		lightDirection.z += level.lightZ[i];
+	}
+
+	return lightDirection;
+}
+
+double BlockPointGrid::unitDensity(int x, int y, int z) const {
+
+	if (sparseStorage) {
+
+		const double *row = sparseRows[x * yElements + y].get();
+		return row ? row[z] : 0.;
+	}
+
+	return density[unitIndex(x, y, z)];
+}
+
+double BlockPointGrid::unitBlockage(int x, int y, int z) const {
+
+	double unitBlockage;
+
+	if (sparseStorage) {
+
+		const double *row = sparseRows[x * yElements + y].get();
+		unitBlockage = row ? row[zElements + z] : 0.;
+	}
+	else if (floatStorage)
+		unitBlockage = floatBlockage[unitIndex(x, y, z)];
+	else
+		unitBlockage = blockage[unitIndex(x, y, z)];
+
+	for (const auto &level : coarseLevels)
+		unitBlockage += level.blockage[level.unitIndex(x >> level.shift, y >> level.shift, z >> level.shift)];
+
+	return unitBlockage;
+}
+
+BlockPointGrid::UnitRun BlockPointGrid::writableRow(int x, int y) {
 
-		xCoord += unitSize;
+	if (!sparseStorage)
+		return this->denseRun(unitIndex(x, y, 0));
+
+	// When several threads update the grid, every row they write to is allocated before they start (see applyConeUpdates()), so
+	// allocating here needs no locking
+	std::size_t r = std::size_t(x) * yElements + y;
+	std::unique_ptr<double[]> &row = sparseRows[r];
+	if (!row) {
+
+		row.reset(new double[5 * zElements]);
+		std::fill(&row[0], &row[2 * zElements], 0.);
+		std::fill(&row[2 * zElements], &row[3 * zElements], maximumLightVector.x);
+		std::fill(&row[3 * zElements], &row[4 * zElements], maximumLightVector.y);
+		std::fill(&row[4 * zElements], &row[5 * zElements], maximumLightVector.z);
+	}
+
+	UnitRun run = {};
+	run.density = row.get();
+	run.blockage = row.get() + zElements;
+	run.lightX = row.get() + 2 * zElements;
+	run.lightY = row.get() + 3 * zElements;
+	run.lightZ = row.get() + 4 * zElements;
+	run.packedQueries = sparsePackedRows[r].get();
+
+	if (double *cache = sparseCacheRows[r].get()) {
+
+		run.cachedDirectionX = cache;
+		run.cachedDirectionY = cache + zElements;
+		run.cachedDirectionZ = cache + 2 * zElements;
+		run.cachedBlockage = cache + 3 * zElements;
 	}
+
+	return run;
+}
+
+std::size_t BlockPointGrid::storedUnitCount() const {
+
+	if (!sparseStorage)
+		return density.size();
+
+	std::size_t rows = 0;
+	for (const auto &row : sparseRows)
+		if (row)
+			++rows;
+
+	return rows * zElements;
 }
 
 BlockPointGrid::BlockPointGrid(double XSIZE, double YSIZE, double ZSIZE, double UNITSIZE, double DETECTIONRANGE, double CONERANGEANGLE,
-							   double INTENSITY) {
+							   double INTENSITY, bool SPARSE) {
 
 	unitSize = UNITSIZE;
+	sparseStorage = SPARSE;
 
 	xElements = std::ceil(XSIZE / UNITSIZE);
 	yElements = std::ceil(YSIZE / UNITSIZE);
@@ -107,244 +556,1672 @@ BlockPointGrid::BlockPointGrid(double XSIZE, double YSIZE, double ZSIZE, double
 	detectionRange = DETECTIONRANGE;
 	coneRangeAngle = CONERANGEANGLE;
 	intensity = INTENSITY;
+	coneKernel = selectConeKernel();
+	floatConeKernel = selectFloatConeKernel();
 	this->setIndexVectorsAndMaximums();
+	this->compileCones(0);
 	this->initiateGrid();
 }
 
-void BlockPointGrid::displayGrid() const {
+BlockPoint *BlockPointGrid::allocateBlockPoint(const Point &loc, double bpDensity, int x, int y, int z) {
 
-	for (int xI = 0; xI < xElements; ++xI) {
+	std::uint32_t slot;
+	if (!freeBlockPointSlots.empty()) {
 
-		for (int yI = 0; yI < yElements; ++yI) {
+		slot = freeBlockPointSlots.back();
+		freeBlockPointSlots.pop_back();
+	}
+	else {
 
-			for (int zI = 0; zI < zElements; ++zI) {
+		slot = blockPointSlots++;
+		if ((slot >> blockPointChunkShift) == blockPointChunks.size())
+			blockPointChunks.emplace_back(new BlockPoint[std::size_t(1) << blockPointChunkShift]);
+	}
 
-				std::string unitName = "[" + std::to_string(xI) + "][" + std::to_string(yI) + "][" + std::to_string(zI) + "]"; +
-					"_Density: " + std::to_string(grid[xI][yI][zI].density);
+	// The slot keeps its generation, which was advanced when its last BlockPoint was removed
+	BlockPoint &bp = this->blockPointInSlot(slot);
+	std::uint32_t generation = bp.generation;
+	bp = BlockPoint(loc, this->storedDensity(bpDensity), x, y, z);
+	bp.slot = slot;
+	bp.generation = generation;
+	bp.live = true;
+	++liveBlockPoints;
 
-				//this->displayUnitLightDirection(xI, yI, zI);
-				this->displayAffectedUnitLightDirection(xI, yI, zI);
-				//this->displayUnitBlockage(xI, yI, zI);
-				//this->displayUnitDensity(xI, yI, zI);
+	return &bp;
+}
 
-				//makeCube(grid[xI][yI][zI].center, unitSize, unitName);
-			}
-		}
-	}
+void BlockPointGrid::releaseBlockPoint(BlockPoint *bp) {
+
+	bp->live = false;
+	++bp->generation;
+	freeBlockPointSlots.push_back(bp->slot);
+	--liveBlockPoints;
 }
 
-void BlockPointGrid::displayGridBorder() const {
+const BlockPoint *BlockPointGrid::getBlockPoint(const BlockPointHandle &handle) const {
+
+	if (handle.slot >= blockPointSlots)
+		return nullptr;
 
-	// assumes cubic grid
-	makeCube(Point(0., (yElements * unitSize) / 2., 0.), (xElements * unitSize), "gridBorder"); 
+	const BlockPoint &bp = this->blockPointInSlot(handle.slot);
+	if (!bp.live || bp.generation != handle.generation)
+		return nullptr;
+
+	return &bp;
 }
 
-void BlockPointGrid::displayUnitsAffectedByUnit(int uX, int uY, int uZ) const {
+PhotStatus BlockPointGrid::addBlockPoint(const Point loc, double bpDensity, BlockPointHandle &handle) {
+
+	BlockPoint *bp = nullptr;
+	PhotStatus status = this->addBlockPoint(loc, bpDensity, bp);
+	handle = bp ? this->handleOf(bp) : BlockPointHandle();
 
-	for (auto indexVect : indexVectorsToUnitsInCone) {
+	return status;
+}
 
-		int X = uX + indexVect.x;
-		int Y = uY + indexVect.y;
-		int Z = uZ + indexVect.z;
+PhotStatus BlockPointGrid::moveBlockPoint(const BlockPointHandle &handle, const Point newLoc) {
 
-		if (this->indicesAreInRange(X, Y, Z)) {
+	if (!this->isValid(handle)) {
 
-			makeCube(grid[X][Y][Z].center, unitSize, "unit");
-		}
+		photLog() << "Error. Block point handle is out of date.\nAborting\n";
+		return PhotStatus::kFailure;
 	}
+
+	return this->moveBlockPoint(&this->blockPointInSlot(handle.slot), newLoc);
+}
+
+PhotStatus BlockPointGrid::addBlockPoints(const std::vector<Point> &locs, const std::vector<double> &bpDensities,
+									   std::vector<BlockPointHandle> &handles) {
+
+	std::vector<BlockPoint*> bps;
+	PhotStatus status = this->addBlockPoints(locs, bpDensities, bps);
+
+	handles.clear();
+	handles.reserve(bps.size());
+	for (const BlockPoint *bp : bps)
+		handles.push_back(bp ? this->handleOf(bp) : BlockPointHandle());
+
+	return status;
 }
 
-void BlockPointGrid::displayUnitsAffectedByBP(const BlockPoint *bp) const {
+PhotStatus BlockPointGrid::moveBlockPoints(const std::vector<BlockPointHandle> &handlesToMove, const std::vector<Point> &newLocs) {
 
-	std::size_t xInd = (bp->loc.x + halfGridXSize) / unitSize;
-	std::size_t yInd = bp->loc.y / unitSize;
-	std::size_t zInd = (bp->loc.z + halfGridZSize) / unitSize;
+	if (handlesToMove.size() != newLocs.size()) {
 
-	displayUnitDensity(xInd, yInd, zInd);
+		photLog() << "Error. Number of block points and new locations differ.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
 
-	for (auto indexVect : indexVectorsToUnitsInCone) {
+	PhotStatus status = PhotStatus::kSuccess;
+	std::vector<BlockPoint*> bps;
+	std::vector<Point> locs;
+	bps.reserve(handlesToMove.size());
+	locs.reserve(newLocs.size());
 
-		int X = xInd + indexVect.x;
-		int Y = yInd + indexVect.y;
-		int Z = zInd + indexVect.z;
+	for (std::size_t i = 0; i < handlesToMove.size(); ++i) {
 
-		if (this->indicesAreInRange(X, Y, Z)) {
+		if (!this->isValid(handlesToMove[i])) {
 
-			displayUnitBlockage(X, Y, Z);
-			//displayUnitDensity(X, Y, Z);
-			displayUnitLightDirection(X, Y, Z);
+			photLog() << "Error. Block point handle is out of date.\n";
+			status = PhotStatus::kFailure;
+			continue;
 		}
+
+		bps.push_back(&this->blockPointInSlot(handlesToMove[i].slot));
+		locs.push_back(newLocs[i]);
 	}
+
+	if (this->moveBlockPoints(bps, locs) != PhotStatus::kSuccess)
+		status = PhotStatus::kFailure;
+
+	return status;
 }
 
-void BlockPointGrid::displayUnitLightDirection(int uX, int uY, int uZ) const {
+PhotStatus BlockPointGrid::removeBlockPoint(const BlockPointHandle &handle) {
+
+	if (!this->isValid(handle)) {
+
+		photLog() << "Error. Block point handle is out of date.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	BlockPoint *bp = &this->blockPointInSlot(handle.slot);
+	this->adjustGrid(bp, subtract);
 
-	// make it so that the arrow's length represents the magnitude of the lightDirection vector, but scaled down so that
-	// the maximum length is equal to unitSize
-	double arrowLength = unitSize * (grid[uX][uY][uZ].lightDirection.getMag() / maximumLightVector.getMag());
+	if (eventLog) {
 
+		this->logEventStart(GridEvent::kRemove, 1);
+		this->logHandle(this->handleOf(bp));
+	}
 
-	makeArrow(grid[uX][uY][uZ].center + Point(0., -unitSize*.5, 0.), CVect(grid[uX][uY][uZ].lightDirection).resized(arrowLength),
-		"lightDirectionArrow", .01);
+	this->releaseBlockPoint(bp);
 
+	return PhotStatus::kSuccess;
 }
 
-void BlockPointGrid::displayAffectedUnitLightDirection(int uX, int uY, int uZ) const {
+PhotStatus BlockPointGrid::setBlockPointDensity(const BlockPointHandle &handle, double newDensity) {
+
+	if (!this->isValid(handle)) {
 
-	//only makeArrow() if the unit has some blockage
-	double percentBlocked = grid[uX][uY][uZ].blockage / maximumBlockage;
-	if (percentBlocked > 0.) {
+		photLog() << "Error. Block point handle is out of date.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	// Applying only the difference gives the same unit density as subtracting the BlockPoint and adding it back, with one
+	// update of the cone instead of two
+	BlockPoint *bp = &this->blockPointInSlot(handle.slot);
+	newDensity = this->storedDensity(newDensity);
+	if (newDensity != bp->density) {
+
+		this->adjustUnitDensity(bp->gridX, bp->gridY, bp->gridZ, newDensity - bp->density);
+		bp->density = newDensity;
+	}
 
-		double arrowLength = unitSize * (1. - percentBlocked);
-		//double arrowLength = unitSize * (grid[uX][uY][uZ].lightDirection.getMag() / maximumLightVector.getMag());
-		//MStreamUtils::stdOutStream() << "arrowLength = " << arrowLength << ", unitSize = " << unitSize << ", percentBlocked = " << percentBlocked << "\n";
-		// size the arrow so that it represents the light strength of the unit 
-		//arrowLength = arrowLength * (1. - grid[uX][uY][uZ].blockage);
+	if (eventLog) {
 
-		makeArrow(grid[uX][uY][uZ].center + Point(0., -unitSize*.5, 0.), CVect(grid[uX][uY][uZ].lightDirection).resized(arrowLength),
-			"lightDirectionArrow", .01);
+		this->logEventStart(GridEvent::kSetDensity, 1);
+		this->logHandle(this->handleOf(bp));
+		this->logValue(newDensity);
 	}
+
+	return PhotStatus::kSuccess;
 }
 
-void BlockPointGrid::displayUnitDensity(int uX, int uY, int uZ) const {
+PhotStatus BlockPointGrid::removeBlockPoints(const std::vector<BlockPointHandle> &handles) {
 
-	if (grid[uX][uY][uZ].density == 0.)
-		return;
+	PhotStatus status = PhotStatus::kSuccess;
+	std::vector<DensityAdjustment> adjustments;
+	adjustments.reserve(handles.size());
 
-	// a unit with maximum density will show an arrow the same size as itself
-	double arrowLength = unitSize * std::min(grid[uX][uY][uZ].density, 1.);
-	Point arrowStart = grid[uX][uY][uZ].center + Point(-unitSize*.25, -unitSize*.5, 0.);
-	makeArrow(arrowStart, CVect(0., arrowLength, 0., arrowLength), "densityArrow", .01);
+	// The handles of the BlockPoints that were removed, for the event log
+	std::vector<BlockPointHandle> removed;
 
-}
+	for (const auto &handle : handles) {
 
-void BlockPointGrid::displayUnitBlockage(int uX, int uY, int uZ) const {
+		if (!this->isValid(handle)) {
 
-	if (grid[uX][uY][uZ].blockage == 0.)
-		return;
+			photLog() << "Error. Block point handle is out of date.\n";
+			status = PhotStatus::kFailure;
+			continue;
+		}
 
-	// a unit with maximum blockage will show an arrow the same size as itself
-	double arrowLength = unitSize * (grid[uX][uY][uZ].blockage / maximumBlockage);
-	Point arrowStart = grid[uX][uY][uZ].center + Point(unitSize*.25, -unitSize*.5, 0.);
-	makeArrow(arrowStart, CVect(0., arrowLength, 0., arrowLength), "blockageArrow", .01);
-}
+		BlockPoint *bp = &this->blockPointInSlot(handle.slot);
+		this->queueDensityAdjustment(adjustments, bp->gridX, bp->gridY, bp->gridZ, -bp->density);
+		if (eventLog)
+			removed.push_back(handle);
+
+		this->releaseBlockPoint(bp);
+	}
 
-void BlockPointGrid::displayBlockPoints() const {
+	if (eventLog) {
 
-	for (auto bp : bps) {
-		int density = bp->density * 1000.;
-		std::string name = "Density--0." + std::to_string(density);
-		makeSphere(bp->loc, .05, name);
+		this->logEventStart(GridEvent::kRemoveBatch, std::uint32_t(removed.size()));
+		for (const auto &handle : removed) {
+
+			this->logHandle(handle);
+		}
 	}
+
+	this->applyDensityAdjustments(adjustments);
+
+	return status;
 }
 
-void BlockPointGrid::displayAll() const {
+PhotStatus BlockPointGrid::setBlockPointDensities(const std::vector<BlockPointHandle> &handles, const std::vector<double> &newDensities) {
 
-	this->displayBlockPoints();
+	if (handles.size() != newDensities.size()) {
 
-	for (int xI = 0; xI < xElements; ++xI) {
+		photLog() << "Error. Number of block points and densities differ.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
 
-		for (int yI = 0; yI < yElements; ++yI) {
+	PhotStatus status = PhotStatus::kSuccess;
+	std::vector<DensityAdjustment> adjustments;
+	adjustments.reserve(handles.size());
 
-			for (int zI = 0; zI < zElements; ++zI) {
+	// The BlockPoints whose density changed, for the event log
+	std::vector<const BlockPoint*> changed;
 
-				displayUnitLightDirection(xI, yI, zI);
-				displayUnitBlockage(xI, yI, zI);
-				displayUnitDensity(xI, yI, zI);
-			}
+	for (std::size_t i = 0; i < handles.size(); ++i) {
+
+		if (!this->isValid(handles[i])) {
+
+			photLog() << "Error. Block point handle is out of date.\n";
+			status = PhotStatus::kFailure;
+			continue;
+		}
+
+		BlockPoint *bp = &this->blockPointInSlot(handles[i].slot);
+		double newDensity = this->storedDensity(newDensities[i]);
+		if (newDensity == bp->density)
+			continue;
+
+		this->queueDensityAdjustment(adjustments, bp->gridX, bp->gridY, bp->gridZ, newDensity - bp->density);
+		bp->density = newDensity;
+		if (eventLog)
+			changed.push_back(bp);
+	}
+
+	if (eventLog) {
+
+		this->logEventStart(GridEvent::kSetDensityBatch, std::uint32_t(changed.size()));
+		for (const BlockPoint *bp : changed) {
+
+			this->logHandle(this->handleOf(bp));
+			this->logValue(bp->density);
 		}
 	}
+
+	this->applyDensityAdjustments(adjustments);
+
+	return status;
 }
 
-MStatus BlockPointGrid::addBlockPoint(const Point loc, double bpDensity, BlockPoint *&ptrForSeg) {
+PhotStatus BlockPointGrid::addBlockPoint(const Point loc, double bpDensity, BlockPoint *&ptrForSeg) {
 
-	std::size_t xInd = (loc.x + halfGridXSize) / unitSize;
-	std::size_t yInd = loc.y / unitSize;
-	std::size_t zInd = (loc.z + halfGridZSize) / unitSize;
+	int xInd, yInd, zInd;
+	this->findUnitIndices(loc, xInd, yInd, zInd);
 
 	if (!this->indicesAreInRange_showError(xInd, yInd, zInd))
-		return MS::kFailure;
+		return PhotStatus::kFailure;
 
-	BlockPoint *newBP = new BlockPoint(loc, bpDensity, xInd, yInd, zInd);
-	bps.push_back(newBP);
+	BlockPoint *newBP = this->allocateBlockPoint(loc, bpDensity, xInd, yInd, zInd);
 	ptrForSeg = newBP;
 
+	if (eventLog) {
+
+		this->logEventStart(GridEvent::kAdd, 1);
+		this->logHandle(this->handleOf(newBP));
+		this->logValue(loc.x);
+		this->logValue(loc.y);
+		this->logValue(loc.z);
+		this->logValue(newBP->density);
+	}
+
 	this->adjustGrid(newBP, add);
 
-	return MS::kSuccess;
+	return PhotStatus::kSuccess;
 }
 
-MStatus BlockPointGrid::moveBlockPoint(BlockPoint *bp, const Point newLoc) {
+PhotStatus BlockPointGrid::moveBlockPoint(BlockPoint *bp, const Point newLoc) {
 
 	// Calculate the BlockPoint's new indices on the bpg
-	std::size_t xInd = (newLoc.x + halfGridXSize) / unitSize;
-	std::size_t yInd = newLoc.y / unitSize;
-	std::size_t zInd = (newLoc.z + halfGridZSize) / unitSize;
+	int xInd, yInd, zInd;
+	this->findUnitIndices(newLoc, xInd, yInd, zInd);
 
 	if (!this->indicesAreInRange_showError(xInd, yInd, zInd))
-		return MS::kFailure;
+		return PhotStatus::kFailure;
 
 	if (xInd != bp->gridX || yInd != bp->gridY || zInd != bp->gridZ) {
 
-		this->adjustGrid(bp, subtract);
+		this->moveUnitDensity(bp->gridX, bp->gridY, bp->gridZ, xInd, yInd, zInd, bp->density);
 		bp->changeGridUnit(xInd, yInd, zInd);
-		this->adjustGrid(bp, add);
+	}
+	else {
+
+		PHOT_STAT(count(statCounters.sameUnitMoves));
 	}
 
 	// set the new location for the block point
 	bp->loc = newLoc;
 
-	return MS::kSuccess;
+	if (eventLog) {
+
+		this->logEventStart(GridEvent::kMove, 1);
+		this->logHandle(this->handleOf(bp));
+		this->logValue(newLoc.x);
+		this->logValue(newLoc.y);
+		this->logValue(newLoc.z);
+	}
+
+	return PhotStatus::kSuccess;
 }
 
-void BlockPointGrid::adjustGrid(const BlockPoint *bp, const adjustment adj) {
+PhotStatus BlockPointGrid::addBlockPoints(const std::vector<Point> &locs, const std::vector<double> &bpDensities,
+									   std::vector<BlockPoint*> &ptrsForSegs) {
 
-	// If adj is add, bp->density will be multiplied by 1.  If s is subtract, bp->density will be multiplied by -1
-	double densityAdjustment = bp->density * adj;
+	if (locs.size() != bpDensities.size()) {
+
+		photLog() << "Error. Number of locations and densities for block points differ.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
 
-	double startingUnitDensity = std::min(grid[bp->gridX][bp->gridY][bp->gridZ].density, 1.);
-	grid[bp->gridX][bp->gridY][bp->gridZ].density += densityAdjustment;
-	double currentUnitDensity = std::min(grid[bp->gridX][bp->gridY][bp->gridZ].density, 1.);
-	double densityChange = currentUnitDensity - startingUnitDensity;
-	double maxLVMag = maximumLightVector.getMag();
-	
-	if (densityChange != 0.) {
+	PhotStatus status = PhotStatus::kSuccess;
+	std::vector<DensityAdjustment> adjustments;
+	adjustments.reserve(locs.size());
+	ptrsForSegs.clear();
+	ptrsForSegs.reserve(locs.size());
 
-		for (const auto &indexVect : indexVectorsToUnitsInCone) {
+	for (std::size_t i = 0; i < locs.size(); ++i) {
 
-			int X = bp->gridX + indexVect.x;
-			int Y = bp->gridY + indexVect.y;
-			int Z = bp->gridZ + indexVect.z;
+		int xInd, yInd, zInd;
+		this->findUnitIndices(locs[i], xInd, yInd, zInd);
 
-			if (this->indicesAreInRange(X, Y, Z)) {
+		if (!this->indicesAreInRange_showError(xInd, yInd, zInd)) {
 
-				//MStreamUtils::stdOutStream() << "X Y Z: " << X << ", " << Y << ", " << Z << ", vect size: " << indexVect.blockageVect.getMag() << "\n";
-				grid[X][Y][Z].lightDirection += indexVect.blockageVect.resized(indexVect.blockageVect.getMag() * densityChange);
-				grid[X][Y][Z].lightDirection.resize(maxLVMag);
-				grid[X][Y][Z].blockage += indexVect.blockageStrength * densityChange;
-			}
+			ptrsForSegs.push_back(nullptr);
+			status = PhotStatus::kFailure;
+			continue;
+		}
+
+		BlockPoint *newBP = this->allocateBlockPoint(locs[i], bpDensities[i], xInd, yInd, zInd);
+		ptrsForSegs.push_back(newBP);
+		this->queueDensityAdjustment(adjustments, xInd, yInd, zInd, newBP->density);
+	}
+
+	if (eventLog) {
+
+		std::uint32_t added = std::uint32_t(std::count_if(ptrsForSegs.begin(), ptrsForSegs.end(), [](const BlockPoint *bp) { return bp; }));
+		this->logEventStart(GridEvent::kAddBatch, added);
+		for (const BlockPoint *bp : ptrsForSegs) {
+
+			if (!bp)
+				continue;
+
+			this->logHandle(this->handleOf(bp));
+			this->logValue(bp->loc.x);
+			this->logValue(bp->loc.y);
+			this->logValue(bp->loc.z);
+			this->logValue(bp->density);
 		}
 	}
+
+	this->applyDensityAdjustments(adjustments);
+
+	return status;
 }
 
-MStatus BlockPointGrid::getDirectionAndBlockage(const Point &meriLoc, CVect &chosenDirection, double &blockage) const {
+void BlockPointGrid::recomputeGrid() {
 
-	std::size_t xInd = (meriLoc.x + halfGridXSize) / unitSize;
-	std::size_t yInd = meriLoc.y / unitSize;
-	std::size_t zInd = (meriLoc.z + halfGridZSize) / unitSize;
+	if (eventLog)
+		this->logEventStart(GridEvent::kRecompute, 0);
 
-	if (!this->indicesAreInRange_showError(xInd, yInd, zInd))
-		return MS::kFailure;
+	this->rebuildGrid();
+}
+
+void BlockPointGrid::rebuildGrid() {
+
+	// Each unit's effective density is one change from zero.  The changes are summed without resizing, then each unit is resized
+	// once if normalization is not deferred.  On large enough grids, the sums are computed as a convolution (see
+	// BlockPointGrid_convolution.cpp), which sets every unit.  Otherwise every unit goes back to its unblocked state, keeping its
+	// density, and each occupied unit's cone is applied
+	std::vector<ConeUpdate> occupied = this->occupiedUnits();
+
+	if (this->convolveGrid(occupied))
+		this->markQueryCacheOutdated();
+	else {
 
-	this->displayUnitLightDirection(xInd, yInd, zInd);
-	//this->displayUnitBlockage(xInd, yInd, zInd);
-	// chosenDirection should have a magnitude of 1, so we need to resize lightDirection here
-	chosenDirection = CVect(grid[xInd][yInd][zInd].lightDirection).resized(1.);
-	blockage = grid[xInd][yInd][zInd].blockage / maximumBlockage;
+		this->resetLightField();
 
-	return MS::kSuccess;
+		ConeKernel resizingKernel = coneKernel;
+		coneKernel = selectConeKernel(false);
+		this->applyConeUpdates(occupied);
+		coneKernel = resizingKernel;
+	}
+
+	if (deferLightNormalization)
+		return;
+
+	for (int x = 0; x < xElements; ++x) {
+		for (int y = 0; y < yElements; ++y) {
+
+			if (sparseStorage && !sparseRows[x * yElements + y])
+				continue;
+
+			UnitRun row = this->writableRow(x, y);
+			for (int z = 0; z < zElements; ++z) {
+
+				double magnitude = std::sqrt(row.lightX[z] * row.lightX[z] + row.lightY[z] * row.lightY[z] + row.lightZ[z] * row.lightZ[z]);
+				if (magnitude == 0.)
+					continue;
+
+				double normalizer = maximumLightMagnitude / magnitude;
+				row.lightX[z] *= normalizer;
+				row.lightY[z] *= normalizer;
+				row.lightZ[z] *= normalizer;
+			}
+		}
+	}
 }
 
+void BlockPointGrid::resetLightField() {
+
+	if (sparseStorage) {
+
+		for (int x = 0; x < xElements; ++x) {
+			for (int y = 0; y < yElements; ++y) {
+
+				if (!sparseRows[x * yElements + y])
+					continue;
+
+				UnitRun row = this->writableRow(x, y);
+				std::fill(row.blockage, row.blockage + zElements, 0.);
+				std::fill(row.lightX, row.lightX + zElements, maximumLightVector.x);
+				std::fill(row.lightY, row.lightY + zElements, maximumLightVector.y);
+				std::fill(row.lightZ, row.lightZ + zElements, maximumLightVector.z);
+				outdateQueries(row, zElements);
+			}
+		}
+	}
+	else {
+
+		std::fill(blockage.begin(), blockage.end(), 0.);
+		std::fill(lightX.begin(), lightX.end(), maximumLightVector.x);
+		std::fill(lightY.begin(), lightY.end(), maximumLightVector.y);
+		std::fill(lightZ.begin(), lightZ.end(), maximumLightVector.z);
+		std::fill(floatBlockage.begin(), floatBlockage.end(), 0.f);
+		std::fill(floatLightX.begin(), floatLightX.end(), float(maximumLightVector.x));
+		std::fill(floatLightY.begin(), floatLightY.end(), float(maximumLightVector.y));
+		std::fill(floatLightZ.begin(), floatLightZ.end(), float(maximumLightVector.z));
+		this->markQueryCacheOutdated();
+	}
+
+	for (auto &level : coarseLevels) {
+
+		std::fill(level.blockage.begin(), level.blockage.end(), 0.);
+		std::fill(level.lightX.begin(), level.lightX.end(), 0.);
+		std::fill(level.lightY.begin(), level.lightY.end(), 0.);
+		std::fill(level.lightZ.begin(), level.lightZ.end(), 0.);
+	}
+}
+
+std::vector<BlockPointGrid::ConeUpdate> BlockPointGrid::occupiedUnits() const {
+
+	std::vector<ConeUpdate> updates;
+	for (int x = 0; x < xElements; ++x) {
+		for (int y = 0; y < yElements; ++y) {
+
+			if (sparseStorage && !sparseRows[x * yElements + y])
+				continue;
+
+			for (int z = 0; z < zElements; ++z) {
+
+				double effectiveDensity = std::min(this->unitDensity(x, y, z), 1.);
+				if (effectiveDensity != 0.)
+					updates.push_back(ConeUpdate(x, y, z, effectiveDensity));
+			}
+		}
+	}
+
+	return updates;
+}
+
+void BlockPointGrid::markQueryCacheOutdated() {
+
+	if (!sparseStorage) {
+
+		std::fill(cachedBlockage.begin(), cachedBlockage.end(), outdated());
+		std::fill(packedQueries.begin(), packedQueries.end(), outdatedPackedQuery());
+		return;
+	}
+
+	for (int x = 0; x < xElements; ++x) {
+		for (int y = 0; y < yElements; ++y) {
+
+			if (sparseRows[x * yElements + y])
+				outdateQueries(this->writableRow(x, y), zElements);
+		}
+	}
+}
+
+void BlockPointGrid::rebuildCone() {
+
+	indexVectorsToUnitsInCone.clear();
+	maximumBlockage = 0.;
+	maximumLightVector = Point(0., 0., 0.);
+
+	this->setIndexVectorsAndMaximums();
+	this->compileCones(int(coarseLevels.size()));
+}
+
+PhotStatus BlockPointGrid::setIntensity(double newIntensity) {
+
+	if (newIntensity < 0.) {
+
+		photLog() << "Error. Intensity cannot be negative.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	if (eventLog) {
+
+		this->logEventStart(GridEvent::kSetIntensity, 1);
+		this->logValue(newIntensity);
+	}
+
+	double ratio = newIntensity / intensity;
+	intensity = newIntensity;
+	this->rebuildCone();
+
+	// Every light weight in the cone is proportional to intensity, and blockage weights do not depend on it.  A unit holds
+	// maximumLightVector plus the sum of its weighted changes, so with normalization deferred, scaling that sum gives the same
+	// field as adding everything again.  Resized light directions no longer hold the sum, so are recomputed, as are exact sums,
+	// which scaling would take off the lattice of the new weights
+	if (!deferLightNormalization || exactAccumulation || !std::isfinite(ratio)) {
+
+		this->rebuildGrid();
+		return PhotStatus::kSuccess;
+	}
+
+	auto rescale = [&](double &component, double base) { component = base + (component - base) * ratio; };
+	auto rescaleFloat = [&](float &component, double base) { component = float(base + (component - base) * ratio); };
+
+	for (int x = 0; x < xElements; ++x) {
+		for (int y = 0; y < yElements; ++y) {
+
+			if (sparseStorage && !sparseRows[x * yElements + y])
+				continue;
+
+			UnitRun row = this->writableRow(x, y);
+			for (int z = 0; z < zElements; ++z) {
+
+				if (floatStorage) {
+
+					rescaleFloat(row.floatLightX[z], maximumLightVector.x);
+					rescaleFloat(row.floatLightY[z], maximumLightVector.y);
+					rescaleFloat(row.floatLightZ[z], maximumLightVector.z);
+					continue;
+				}
+
+				rescale(row.lightX[z], maximumLightVector.x);
+				rescale(row.lightY[z], maximumLightVector.y);
+				rescale(row.lightZ[z], maximumLightVector.z);
+			}
+		}
+	}
+
+	for (auto &level : coarseLevels) {
+
+		for (std::size_t i = 0; i < level.lightX.size(); ++i) {
+
+			rescale(level.lightX[i], 0.);
+			rescale(level.lightY[i], 0.);
+			rescale(level.lightZ[i], 0.);
+		}
+	}
+
+	this->markQueryCacheOutdated();
+	if (!coarseLevels.empty())
+		coarseLevelsChanged = true;
+
+	return PhotStatus::kSuccess;
+}
+
+PhotStatus BlockPointGrid::setConeRangeAngle(double newConeRangeAngle) {
+
+	if (newConeRangeAngle <= 0. || newConeRangeAngle > MM::PI) {
+
+		photLog() << "Error. Cone range angle must be greater than 0 and at most pi.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	if (eventLog) {
+
+		this->logEventStart(GridEvent::kSetConeRangeAngle, 1);
+		this->logValue(newConeRangeAngle);
+	}
+
+	std::vector<IndexVector> oldIndexVects = indexVectorsToUnitsInCone;
+	Point oldMaximumLightVector = maximumLightVector;
+	double oldMaximumLightMagnitude = maximumLightMagnitude;
+
+	coneRangeAngle = newConeRangeAngle;
+	this->rebuildCone();
+
+	if (!deferLightNormalization || exactAccumulation || !coarseLevels.empty()) {
+
+		this->rebuildGrid();
+		return PhotStatus::kSuccess;
+	}
+
+	// Index vectors in both cones keep their blockageStrength, and their light weights scale with the magnitude of
+	// maximumLightVector.  So, with normalization deferred, each unit's sum of light changes is scaled, and only the index
+	// vectors that entered or left the cone need to be applied, as a cone of their own: entering ones with their new weights,
+	// and leaving ones with their old weights, scaled and negated
+	double ratio = maximumLightMagnitude / oldMaximumLightMagnitude;
+
+	auto key = [](const IndexVector &v) { return std::make_tuple(v.x, v.y, v.z); };
+	auto byKey = [&](const IndexVector &a, const IndexVector &b) { return key(a) < key(b); };
+
+	std::vector<IndexVector> newIndexVects = indexVectorsToUnitsInCone;
+	std::sort(oldIndexVects.begin(), oldIndexVects.end(), byKey);
+	std::sort(newIndexVects.begin(), newIndexVects.end(), byKey);
+
+	std::vector<IndexVector> changedIndexVects;
+	std::set_difference(newIndexVects.begin(), newIndexVects.end(), oldIndexVects.begin(), oldIndexVects.end(),
+		std::back_inserter(changedIndexVects), byKey);
+
+	std::vector<IndexVector> leavingIndexVects;
+	std::set_difference(oldIndexVects.begin(), oldIndexVects.end(), newIndexVects.begin(), newIndexVects.end(),
+		std::back_inserter(leavingIndexVects), byKey);
+
+	for (auto v : leavingIndexVects) {
+
+		v.blockageVect.resize(-v.blockageVect.getMag() * ratio);
+		v.blockageStrength = -v.blockageStrength;
+		changedIndexVects.push_back(v);
+	}
+
+	std::sort(changedIndexVects.begin(), changedIndexVects.end(), byKey);
+
+	for (int x = 0; x < xElements; ++x) {
+		for (int y = 0; y < yElements; ++y) {
+
+			if (sparseStorage && !sparseRows[x * yElements + y])
+				continue;
+
+			UnitRun row = this->writableRow(x, y);
+			for (int z = 0; z < zElements; ++z) {
+
+				if (floatStorage) {
+
+					row.floatLightX[z] = float(maximumLightVector.x + (row.floatLightX[z] - oldMaximumLightVector.x) * ratio);
+					row.floatLightY[z] = float(maximumLightVector.y + (row.floatLightY[z] - oldMaximumLightVector.y) * ratio);
+					row.floatLightZ[z] = float(maximumLightVector.z + (row.floatLightZ[z] - oldMaximumLightVector.z) * ratio);
+					continue;
+				}
+
+				row.lightX[z] = maximumLightVector.x + (row.lightX[z] - oldMaximumLightVector.x) * ratio;
+				row.lightY[z] = maximumLightVector.y + (row.lightY[z] - oldMaximumLightVector.y) * ratio;
+				row.lightZ[z] = maximumLightVector.z + (row.lightZ[z] - oldMaximumLightVector.z) * ratio;
+			}
+		}
+	}
+
+	// applyConeUpdates() applies cone, so the changed index vectors stand in for it while they are applied
+	Cone changedCone;
+	compileCone(changedIndexVects, yElements, zElements, changedCone);
+	std::swap(cone, changedCone);
+	this->applyConeUpdates(this->occupiedUnits());
+	std::swap(cone, changedCone);
+
+	this->markQueryCacheOutdated();
+
+	return PhotStatus::kSuccess;
+}
+
+PhotStatus BlockPointGrid::setDetectionRange(double newDetectionRange) {
+
+	// The cone must reach at least one unit, and the full resolution part must too when there are coarse levels
+	int maxIndexDiff = newDetectionRange / unitSize;
+	if ((maxIndexDiff >> coarseLevels.size()) < 1) {
+
+		photLog() << "Error. Detection range is too small for the unit size and coarse levels.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	if (eventLog) {
+
+		this->logEventStart(GridEvent::kSetDetectionRange, 1);
+		this->logValue(newDetectionRange);
+	}
+
+	// Every blockageStrength depends on detectionRange, so the whole grid is recomputed
+	detectionRange = newDetectionRange;
+	this->rebuildCone();
+	this->rebuildGrid();
+
+	return PhotStatus::kSuccess;
+}
+
+PhotStatus BlockPointGrid::moveBlockPoints(const std::vector<BlockPoint*> &bpsToMove, const std::vector<Point> &newLocs) {
+
+	if (bpsToMove.size() != newLocs.size()) {
+
+		photLog() << "Error. Number of block points and new locations differ.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	PhotStatus status = PhotStatus::kSuccess;
+	std::vector<DensityAdjustment> adjustments;
+
+	// The BlockPoints that were moved, for the event log
+	std::vector<std::size_t> moved;
+
+	for (std::size_t i = 0; i < bpsToMove.size(); ++i) {
+
+		BlockPoint *bp = bpsToMove[i];
+
+		int xInd, yInd, zInd;
+		this->findUnitIndices(newLocs[i], xInd, yInd, zInd);
+
+		if (!this->indicesAreInRange_showError(xInd, yInd, zInd)) {
+
+			status = PhotStatus::kFailure;
+			continue;
+		}
+
+		if (eventLog)
+			moved.push_back(i);
+
+		if (xInd != bp->gridX || yInd != bp->gridY || zInd != bp->gridZ) {
+
+			this->queueDensityAdjustment(adjustments, bp->gridX, bp->gridY, bp->gridZ, -bp->density);
+			this->queueDensityAdjustment(adjustments, xInd, yInd, zInd, bp->density);
+			bp->changeGridUnit(xInd, yInd, zInd);
+		}
+		else {
+
+			PHOT_STAT(count(statCounters.sameUnitMoves));
+		}
+
+		bp->loc = newLocs[i];
+	}
+
+	if (eventLog) {
+
+		this->logEventStart(GridEvent::kMoveBatch, std::uint32_t(moved.size()));
+		for (std::size_t i : moved) {
+
+			this->logHandle(this->handleOf(bpsToMove[i]));
+			this->logValue(newLocs[i].x);
+			this->logValue(newLocs[i].y);
+			this->logValue(newLocs[i].z);
+		}
+	}
+
+	this->applyDensityAdjustments(adjustments);
+
+	return status;
+}
+
+void BlockPointGrid::adjustGrid(const BlockPoint *bp, const adjustment adj) {
+
+	// If adj is add, bp->density will be multiplied by 1.  If s is subtract, bp->density will be multiplied by -1
+	this->adjustUnitDensity(bp->gridX, bp->gridY, bp->gridZ, bp->density * adj);
+}
+
+double BlockPointGrid::changeUnitDensity(int x, int y, int z, double densityAdjustment) {
+
+	double &unitDensity = this->writableRow(x, y).density[z];
+	double startingUnitDensity = std::min(unitDensity, 1.);
+	unitDensity += densityAdjustment;
+	double currentUnitDensity = std::min(unitDensity, 1.);
+
+	return currentUnitDensity - startingUnitDensity;
+}
+
+bool BlockPointGrid::absorbSaturatedAdjustment(int x, int y, int z, double densityAdjustment) {
+
+	double unitDensity = this->unitDensity(x, y, z);
+	if (unitDensity < 1. || unitDensity + densityAdjustment < 1.)
+		return false;
+
+	this->writableRow(x, y).density[z] = unitDensity + densityAdjustment;
+	PHOT_STAT(count(statCounters.saturatedUpdates));
+
+	return true;
+}
+
+void BlockPointGrid::queueDensityAdjustment(std::vector<DensityAdjustment> &adjustments, int x, int y, int z, double densityAdjustment) {
+
+	if (!this->absorbSaturatedAdjustment(x, y, z, densityAdjustment))
+		adjustments.push_back(DensityAdjustment(unitIndex(x, y, z), densityAdjustment));
+}
+
+void BlockPointGrid::adjustUnitDensity(int x, int y, int z, double densityAdjustment) {
+
+	PHOT_STAT(count(statCounters.adjustGridCalls));
+	PHOT_STAT(StatTimer timer(statCounters.adjustGridNanoseconds));
+
+	if (this->absorbSaturatedAdjustment(x, y, z, densityAdjustment))
+		return;
+
+	double densityChange = this->changeUnitDensity(x, y, z, densityAdjustment);
+
+	if (densityChange == 0.) {
+
+		PHOT_STAT(count(statCounters.unchangedDensityUpdates));
+		return;
+	}
+
+	if (!coarseLevels.empty())
+		coarseLevelsChanged = true;
+
+	this->applyCone(x, y, z, densityChange);
+}
+
+void BlockPointGrid::moveUnitDensity(int fromX, int fromY, int fromZ, int toX, int toY, int toZ, double densityAdjustment) {
+
+	int stencil = shiftStencils.empty() ? -1 : shiftStencilIndex(toX - fromX, toY - fromY, toZ - fromZ);
+	if (stencil < 0 || shiftStencils[stencil].runs.empty()) {
+
+		this->adjustUnitDensity(fromX, fromY, fromZ, -densityAdjustment);
+		this->adjustUnitDensity(toX, toY, toZ, densityAdjustment);
+		return;
+	}
+
+	PHOT_STAT(count(statCounters.adjustGridCalls, 2));
+	PHOT_STAT(StatTimer timer(statCounters.adjustGridNanoseconds));
+
+	bool fromAbsorbed = this->absorbSaturatedAdjustment(fromX, fromY, fromZ, -densityAdjustment);
+	bool toAbsorbed = this->absorbSaturatedAdjustment(toX, toY, toZ, densityAdjustment);
+	double fromChange = fromAbsorbed ? 0. : this->changeUnitDensity(fromX, fromY, fromZ, -densityAdjustment);
+	double toChange = toAbsorbed ? 0. : this->changeUnitDensity(toX, toY, toZ, densityAdjustment);
+
+	PHOT_STAT(count(statCounters.unchangedDensityUpdates, int(!fromAbsorbed && fromChange == 0.) + int(!toAbsorbed && toChange == 0.)));
+
+	if (fromChange == 0. && toChange == 0.)
+		return;
+
+	if (!coarseLevels.empty())
+		coarseLevelsChanged = true;
+
+	// When a unit is or becomes full, the clamped changes of the two units differ and their cones do not cancel, so each is
+	// applied on its own
+	if (fromChange != -toChange) {
+
+		if (fromChange != 0.)
+			this->applyCone(fromX, fromY, fromZ, fromChange);
+
+		if (toChange != 0.)
+			this->applyCone(toX, toY, toZ, toChange);
+
+		return;
+	}
+
+	PHOT_STAT(count(statCounters.stencilMoves));
+
+	for (auto &level : coarseLevels) {
+
+		// A move within one coarse unit leaves the level as it was
+		if ((fromX >> level.shift) == (toX >> level.shift) && (fromY >> level.shift) == (toY >> level.shift) &&
+			(fromZ >> level.shift) == (toZ >> level.shift))
+			continue;
+
+		this->applyCoarseCone(level, fromX, fromY, fromZ, fromChange);
+		this->applyCoarseCone(level, toX, toY, toZ, toChange);
+	}
+
+	// The stencil stands in for two cones, but is applied once
+	PHOT_STAT(count(statCounters.conesApplied));
+
+	this->applyConeRuns(shiftStencils[stencil], fromX, fromY, fromZ, toChange);
+}
+
+void BlockPointGrid::applyDensityAdjustments(std::vector<DensityAdjustment> &adjustments) {
+
+	PHOT_STAT(count(statCounters.batchUpdates));
+	PHOT_STAT(StatTimer timer(statCounters.batchUpdateNanoseconds));
+
+	// Sorting brings together the adjustments to each unit, and also means the grid is updated in memory order
+	std::stable_sort(adjustments.begin(), adjustments.end());
+
+	std::vector<ConeUpdate> updates;
+
+	std::size_t i = 0;
+	while (i < adjustments.size()) {
+
+		std::size_t unit = adjustments[i].unit;
+		double totalAdjustment = 0.;
+
+		// The rounding error of each addition is carried along and added back at the end (Neumaier summation), so adjustments
+		// that cancel out, such as a BlockPoint leaving the unit while others with the same total density enter it, usually
+		// total zero, and otherwise a residue of a few ulps of the largest adjustment.  Only exact accumulation, where every sum
+		// is exact, guarantees zero
+		double roundingError = 0.;
+
+		for (; i < adjustments.size() && adjustments[i].unit == unit; ++i) {
+
+			double amount = adjustments[i].amount;
+			double sum = totalAdjustment + amount;
+			if (std::fabs(totalAdjustment) >= std::fabs(amount))
+				roundingError += (totalAdjustment - sum) + amount;
+			else
+				roundingError += (amount - sum) + totalAdjustment;
+
+			totalAdjustment = sum;
+		}
+
+		totalAdjustment += roundingError;
+
+		if (totalAdjustment == 0.) {
+
+			PHOT_STAT(count(statCounters.unchangedDensityUpdates));
+			continue;
+		}
+
+		int x, y, z;
+		this->unitIndices(unit, x, y, z);
+		double densityChange = this->changeUnitDensity(x, y, z, totalAdjustment);
+
+		if (densityChange == 0.) {
+
+			PHOT_STAT(count(statCounters.unchangedDensityUpdates));
+			continue;
+		}
+
+		updates.push_back(ConeUpdate(x, y, z, densityChange));
+	}
+
+	this->applyConeUpdates(updates);
+}
+
+void BlockPointGrid::applyConeUpdates(const std::vector<ConeUpdate> &updates) {
+
+	if (updates.empty())
+		return;
+
+	if (!coarseLevels.empty())
+		coarseLevelsChanged = true;
+
+	int tileX, tileY, tileZ;
+	this->tileSize(tileX, tileY, tileZ);
+	int halfTilesX = ((xElements + tileX - 1) / tileX + 1) / 2;
+	int halfTilesY = ((yElements + tileY - 1) / tileY + 1) / 2;
+	int halfTilesZ = ((zElements + tileZ - 1) / tileZ + 1) / 2;
+	int tilesPerColor = halfTilesX * halfTilesY * halfTilesZ;
+
+	// Tiles are numbered color by color, so the tiles of each color are consecutive
+	auto tileOf = [&](const ConeUpdate &update) {
+
+		int tX = update.x / tileX, tY = update.y / tileY, tZ = update.z / tileZ;
+		int color = ((tX & 1) << 2) | ((tY & 1) << 1) | (tZ & 1);
+		return color * tilesPerColor + ((tX >> 1) * halfTilesY + (tY >> 1)) * halfTilesZ + (tZ >> 1);
+	};
+
+	// Counting sort by tile, which keeps the order of the updates in each tile.  Tile t's updates are from tileStarts[t] to
+	// tileStarts[t + 1]
+	std::vector<std::size_t> tileStarts(std::size_t(8) * tilesPerColor + 1, 0);
+	for (const auto &update : updates)
+		++tileStarts[tileOf(update) + 1];
+
+	for (std::size_t t = 1; t < tileStarts.size(); ++t)
+		tileStarts[t] += tileStarts[t - 1];
+
+	std::vector<ConeUpdate> sorted(updates);
+	{
+		std::vector<std::size_t> next(tileStarts.begin(), tileStarts.end() - 1);
+		for (const auto &update : updates)
+			sorted[next[tileOf(update)]++] = update;
+	}
+
+	// Threads only write to sparse rows that already exist, since two tiles of the same color can share rows
+	std::size_t threads = std::min<std::size_t>(threadCount, updates.size());
+	if (sparseStorage && threads > 1) {
+
+		for (const auto &update : updates)
+			this->allocateRowsInCone(cone, update.x, update.y, update.z);
+	}
+
+	std::vector<int> tilesToUpdate;
+	for (int color = 0; color < 8; ++color) {
+
+		tilesToUpdate.clear();
+		for (int t = color * tilesPerColor; t < (color + 1) * tilesPerColor; ++t) {
+
+			if (tileStarts[t] != tileStarts[t + 1])
+				tilesToUpdate.push_back(t);
+		}
+
+		std::atomic<std::size_t> nextTile(0);
+
+		this->runOnThreads(tilesToUpdate.size(), [&]() {
+
+			for (std::size_t i = nextTile++; i < tilesToUpdate.size(); i = nextTile++) {
+
+				int t = tilesToUpdate[i];
+				for (std::size_t u = tileStarts[t]; u < tileStarts[t + 1]; ++u)
+					this->applyCone(sorted[u].x, sorted[u].y, sorted[u].z, sorted[u].densityChange);
+			}
+		});
+	}
+}
+
+void BlockPointGrid::applyCone(int x, int y, int z, double densityChange) {
+
+	for (auto &level : coarseLevels)
+		this->applyCoarseCone(level, x, y, z, densityChange);
+
+	PHOT_STAT(count(statCounters.conesApplied));
+
+	this->applyConeRuns(cone, x, y, z, densityChange);
+}
+
+void BlockPointGrid::applyConeRuns(const Cone &source, int x, int y, int z, double densityChange) {
+
+	// Most units are far enough from the borders of the grid that every run fits.  With dense storage, each run's units are
+	// then a fixed distance from the source unit in memory
+	if (!sparseStorage && this->coneFitsOnGrid(source, x, y, z)) {
+
+		std::size_t sourceUnit = unitIndex(x, y, z);
+		for (const auto &run : source.runs)
+			this->applyConeEntries(source, this->denseRun(sourceUnit + run.offset), run.firstEntry, run.length, densityChange);
+
+		PHOT_STAT(count(statCounters.coneEntriesApplied, source.strength.size()));
+		return;
+	}
+
+	PHOT_STAT(std::uint64_t applied = 0);
+
+	// Otherwise, skip runs that fall off the grid and clip the ends of the rest
+	for (const auto &run : source.runs) {
+
+		int X = x + run.x;
+		int Y = y + run.y;
+
+		if (X < 0 || X >= xElements || Y < 0 || Y >= yElements)
+			continue;
+
+		int firstZ = std::max(z + run.zStart, 0);
+		int lastZ = std::min(z + run.zStart + run.length, zElements) - 1;
+
+		if (firstZ > lastZ)
+			continue;
+
+		int skipped = firstZ - (z + run.zStart);
+		this->applyConeEntries(source, this->writableRow(X, Y) + firstZ, run.firstEntry + skipped, lastZ - firstZ + 1, densityChange);
+		PHOT_STAT(applied += lastZ - firstZ + 1);
+	}
+
+	PHOT_STAT(count(statCounters.coneEntriesApplied, applied));
+	PHOT_STAT(count(statCounters.coneEntriesClipped, source.strength.size() - applied));
+}
+
+void BlockPointGrid::applyCoarseCone(CoarseLevel &level, int x, int y, int z, double densityChange) {
+
+	// Coarse levels are small, so every run is simply checked against the borders
+	x >>= level.shift;
+	y >>= level.shift;
+	z >>= level.shift;
+
+	for (const auto &run : level.cone.runs) {
+
+		int X = x + run.x;
+		int Y = y + run.y;
+
+		if (X < 0 || X >= level.xElements || Y < 0 || Y >= level.yElements)
+			continue;
+
+		int firstZ = std::max(z + run.zStart, 0);
+		int lastZ = std::min(z + run.zStart + run.length, level.zElements) - 1;
+
+		if (firstZ > lastZ)
+			continue;
+
+		int i = level.unitIndex(X, Y, firstZ);
+		int entry = run.firstEntry + firstZ - (z + run.zStart);
+		coneKernel(&level.lightX[i], &level.lightY[i], &level.lightZ[i], &level.blockage[i], &level.cone.lightX[entry],
+			&level.cone.lightY[entry], &level.cone.lightZ[entry], &level.cone.strength[entry], lastZ - firstZ + 1, densityChange,
+			maximumLightMagnitude);
+		PHOT_STAT(count(statCounters.coarseEntriesApplied, lastZ - firstZ + 1));
+	}
+}
+
+void BlockPointGrid::tileSize(int &x, int &y, int &z) const {
+
+	x = std::max(cone.maxX - cone.minX, 1);
+	y = std::max(cone.maxY - cone.minY, 1);
+	z = std::max(cone.maxZ - cone.minZ, 1);
+
+	// Units in tiles of the same color are at least size + 1 apart on some axis, so at least (size + 1) / 2^shift - 1 apart on a
+	// coarse level
+	for (const auto &level : coarseLevels) {
+
+		x = std::max(x, (level.cone.maxX - level.cone.minX + 2) << level.shift);
+		y = std::max(y, (level.cone.maxY - level.cone.minY + 2) << level.shift);
+		z = std::max(z, (level.cone.maxZ - level.cone.minZ + 2) << level.shift);
+	}
+
+	// Small cones on large grids would give more tiles than are useful, and cost more to sort updates into.  64 tiles per axis
+	// is still far more tiles of each color than threads
+	const int maximumTiles = 64;
+	x = std::max(x, (xElements + maximumTiles - 1) / maximumTiles);
+	y = std::max(y, (yElements + maximumTiles - 1) / maximumTiles);
+	z = std::max(z, (zElements + maximumTiles - 1) / maximumTiles);
+}
+
+void BlockPointGrid::allocateRowsInCone(const Cone &source, int x, int y, int z) {
+
+	// The same runs applyConeRuns() skips are skipped here
+	for (const auto &run : source.runs) {
+
+		int X = x + run.x;
+		int Y = y + run.y;
+
+		if (X < 0 || X >= xElements || Y < 0 || Y >= yElements || sparseRows[X * yElements + Y])
+			continue;
+
+		if (std::max(z + run.zStart, 0) <= std::min(z + run.zStart + run.length, zElements) - 1)
+			this->writableRow(X, Y);
+	}
+}
+
+void BlockPointGrid::applyConeEntries(const Cone &source, const UnitRun &units, int firstEntry, int count, double densityChange) {
+
+	if (floatStorage)
+		floatConeKernel(units.floatLightX, units.floatLightY, units.floatLightZ, units.floatBlockage, &source.lightX[firstEntry],
+			&source.lightY[firstEntry], &source.lightZ[firstEntry], &source.strength[firstEntry], count, densityChange);
+	else
+		coneKernel(units.lightX, units.lightY, units.lightZ, units.blockage, &source.lightX[firstEntry],
+			&source.lightY[firstEntry], &source.lightZ[firstEntry], &source.strength[firstEntry], count, densityChange, maximumLightMagnitude);
+
+	outdateQueries(units, count);
+}
+
+PhotStatus BlockPointGrid::setDeferredNormalization(bool defer) {
+
+	if (eventLog) {
+
+		photLog() << "Error. Normalization cannot be changed while events are logged.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	if (liveBlockPoints > 0) {
+
+		photLog() << "Error. Normalization can only be changed before block points are added.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	if (!defer && !coarseLevels.empty()) {
+
+		photLog() << "Error. Normalization must be deferred while the grid has coarse levels.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	if (!defer && exactAccumulation) {
+
+		photLog() << "Error. Normalization must be deferred while accumulation is exact.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	if (!defer && useShiftStencils) {
+
+		photLog() << "Error. Normalization must be deferred while shift stencils are used.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	if (!defer && floatStorage) {
+
+		photLog() << "Error. Normalization must be deferred while the light field is stored in floats.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	deferLightNormalization = defer;
+	coneKernel = selectConeKernel(!defer);
+
+	return PhotStatus::kSuccess;
+}
+
+PhotStatus BlockPointGrid::setExactAccumulation(bool exact) {
+
+	if (eventLog) {
+
+		photLog() << "Error. Exact accumulation cannot be changed while events are logged.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	if (liveBlockPoints > 0) {
+
+		photLog() << "Error. Exact accumulation can only be changed before block points are added.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	if (exact && !coarseLevels.empty()) {
+
+		photLog() << "Error. Coarse levels cannot be used while accumulation is exact.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	if (exact && floatStorage) {
+
+		photLog() << "Error. Exact accumulation cannot be used while the light field is stored in floats.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	exactAccumulation = exact;
+	if (exact) {
+
+		deferLightNormalization = true;
+		coneKernel = selectConeKernel(false);
+	}
+
+	// The weights and maximumLightVector change, so units are reset to the new maximumLightVector
+	this->rebuildCone();
+	this->rebuildGrid();
+
+	return PhotStatus::kSuccess;
+}
+
+PhotStatus BlockPointGrid::setFloatStorage(bool useFloats) {
+
+	if (eventLog) {
+
+		photLog() << "Error. Float storage cannot be changed while events are logged.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	if (liveBlockPoints > 0) {
+
+		photLog() << "Error. Float storage can only be changed before block points are added.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	if (useFloats && exactAccumulation) {
+
+		photLog() << "Error. Exact accumulation cannot be used while the light field is stored in floats.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	if (useFloats && sparseStorage) {
+
+		photLog() << "Error. Float storage is only available for grids with dense storage.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	if (useFloats) {
+
+		deferLightNormalization = true;
+		coneKernel = selectConeKernel(false);
+	}
+
+	// Without BlockPoints, every unit is unblocked, so the arrays are simply allocated again in the new type
+	floatStorage = useFloats;
+	this->initiateGrid();
+
+	return PhotStatus::kSuccess;
+}
+
+PhotStatus BlockPointGrid::setCoarseLevels(int levels) {
+
+	if (eventLog) {
+
+		photLog() << "Error. Coarse levels cannot be changed while events are logged.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	if (liveBlockPoints > 0) {
+
+		photLog() << "Error. Coarse levels can only be changed before block points are added.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	if (levels > 0 && exactAccumulation) {
+
+		photLog() << "Error. Coarse levels cannot be used while accumulation is exact.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	// The full resolution part of the cone must still reach at least one unit below
+	int maxIndexDiff = detectionRange / unitSize;
+	if (levels < 0 || levels > 30 || (maxIndexDiff >> levels) < 1) {
+
+		photLog() << "Error. " << levels << " coarse levels is not possible with this detection range and unit size.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	if (levels > 0) {
+
+		deferLightNormalization = true;
+		coneKernel = selectConeKernel(false);
+	}
+
+	this->compileCones(levels);
+
+	return PhotStatus::kSuccess;
+}
+
+PhotStatus BlockPointGrid::setShiftStencils(bool use) {
+
+	if (eventLog) {
+
+		photLog() << "Error. Shift stencils cannot be changed while events are logged.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	if (use && !deferLightNormalization) {
+
+		if (liveBlockPoints > 0) {
+
+			photLog() << "Error. Shift stencils need deferred normalization, which can only be turned on before block points are added.\nAborting\n";
+			return PhotStatus::kFailure;
+		}
+
+		deferLightNormalization = true;
+		coneKernel = selectConeKernel(false);
+	}
+
+	useShiftStencils = use;
+	this->compileCones(int(coarseLevels.size()));
+
+	return PhotStatus::kSuccess;
+}
+
+PhotStatus BlockPointGrid::getDirectionAndBlockage(const Point &meriLoc, CVect &chosenDirection, double &blockage) const {
+
+	PHOT_STAT(count(statCounters.queries));
+	PHOT_STAT(StatTimer timer(statCounters.queryNanoseconds));
+
+	int xInd, yInd, zInd;
+	this->findUnitIndices(meriLoc, xInd, yInd, zInd);
+
+	if (!this->indicesAreInRange_showError(xInd, yInd, zInd))
+		return PhotStatus::kFailure;
+
+	if (interpolateQueries)
+		this->interpolatedQueryResult(meriLoc, chosenDirection, blockage);
+	else
+		this->unitQueryResult(xInd, yInd, zInd, chosenDirection, blockage);
+
+	return PhotStatus::kSuccess;
+}
+
+PhotStatus BlockPointGrid::getDirectionsAndBlockages(const std::vector<Point> &meriLocs, std::vector<CVect> &chosenDirections,
+													std::vector<double> &blockages, bool sortByUnit) const {
+
+	PHOT_STAT(count(statCounters.queries, meriLocs.size()));
+	PHOT_STAT(StatTimer timer(statCounters.queryNanoseconds));
+
+	chosenDirections.resize(meriLocs.size(), CVect(0., 0., 0., 0.));
+	blockages.resize(meriLocs.size());
+
+	// Counted rather than reported as they are found, since several threads may find them
+	std::atomic<std::size_t> outside(0);
+
+	auto answer = [&](int x, int y, int z, std::size_t i) {
+
+		if (!this->indicesAreInRange(x, y, z)) {
+
+			chosenDirections[i].set(0., 0., 0., 0.);
+			blockages[i] = 0.;
+			++outside;
+		}
+		else if (interpolateQueries)
+			this->interpolatedQueryResult(meriLocs[i], chosenDirections[i], blockages[i]);
+		else
+			this->unitQueryResult(x, y, z, chosenDirections[i], blockages[i]);
+	};
+
+	if (!sortByUnit) {
+
+		this->splitBetweenThreads(meriLocs.size(), [&](std::size_t first, std::size_t last) {
+
+			for (std::size_t i = first; i < last; ++i) {
+
+				int xInd, yInd, zInd;
+				this->findUnitIndices(meriLocs[i], xInd, yInd, zInd);
+				answer(xInd, yInd, zInd, i);
+			}
+		});
+	}
+	else {
+
+		std::vector<MeristemQuery> queries;
+		queries.reserve(meriLocs.size());
+
+		for (std::size_t i = 0; i < meriLocs.size(); ++i) {
+
+			int xInd, yInd, zInd;
+			this->findUnitIndices(meriLocs[i], xInd, yInd, zInd);
+			queries.push_back(MeristemQuery(unitIndex(xInd, yInd, zInd), xInd, yInd, zInd, i));
+		}
+
+		std::sort(queries.begin(), queries.end());
+
+		this->splitBetweenThreads(queries.size(), [&](std::size_t first, std::size_t last) {
+
+			for (std::size_t q = first; q < last; ++q)
+				answer(queries[q].x, queries[q].y, queries[q].z, queries[q].position);
+		});
+	}
+
+	if (outside > 0) {
+
+		photLog() << "Error. " << outside << " meristem locations are outside of the grid\n";
+		return PhotStatus::kFailure;
+	}
+
+	return PhotStatus::kSuccess;
+}
+
+void BlockPointGrid::setThreadCount(int threads) {
+
+	threadCount = std::max(threads, 1);
+	workerPool.reset(threadCount > 1 ? new WorkerPool(threadCount) : nullptr);
+}
+
+void BlockPointGrid::runOnThreads(std::size_t threads, const std::function<void()> &work) const {
+
+	if (workerPool && threads > 1)
+		workerPool->run(int(std::min<std::size_t>(threads, threadCount)), work);
+	else
+		work();
+}
+
+void BlockPointGrid::splitBetweenThreads(std::size_t count, const std::function<void(std::size_t, std::size_t)> &work) const {
+
+	// Small amounts of work are not worth sharing
+	const std::size_t minimumPerThread = 4096;
+	std::size_t shares = std::max<std::size_t>(std::min<std::size_t>(threadCount, count / minimumPerThread), 1);
+	std::size_t shareSize = (count + shares - 1) / shares;
+	std::atomic<std::size_t> nextShare(0);
+
+	this->runOnThreads(shares, [&]() {
+
+		for (std::size_t s = nextShare++; s < shares; s = nextShare++)
+			work(s * shareSize, std::min((s + 1) * shareSize, count));
+	});
+}
+
+void BlockPointGrid::unitQueryResult(int x, int y, int z, CVect &chosenDirection, double &blockage) const {
+
+	if (!this->cachedQueryResult(x, y, z, chosenDirection, blockage))
+		this->queryResult(this->storedLightDirection(x, y, z), this->unitBlockage(x, y, z), chosenDirection, blockage);
+}
+
+void BlockPointGrid::interpolatedQueryResult(const Point &meriLoc, CVect &chosenDirection, double &blockage) const {
+
+	// The location in units, measured from the center of the unit with indices (0, 0, 0)
+	double unitsX = (meriLoc.x + halfGridXSize) / unitSize - .5;
+	double unitsY = meriLoc.y / unitSize - .5;
+	double unitsZ = (meriLoc.z + halfGridZSize) / unitSize - .5;
+
+	// The indices of the unit centers on either side of the location on each axis, and the weight of the higher one.  Beyond
+	// the outermost unit centers, the outermost units are used on both sides
+	int x[2], y[2], z[2];
+	double weightX, weightY, weightZ;
+	this->interpolationIndices(unitsX, xElements, x, weightX);
+	this->interpolationIndices(unitsY, yElements, y, weightY);
+	this->interpolationIndices(unitsZ, zElements, z, weightZ);
+
+	double directionX = 0., directionY = 0., directionZ = 0.;
+	blockage = 0.;
+
+	for (int i = 0; i < 8; ++i) {
+
+		int xSide = i >> 2, ySide = (i >> 1) & 1, zSide = i & 1;
+		double weight = (xSide ? weightX : 1. - weightX) * (ySide ? weightY : 1. - weightY) * (zSide ? weightZ : 1. - weightZ);
+
+		CVect cornerDirection(0., 0., 0., 0.);
+		double cornerBlockage;
+		this->unitQueryResult(x[xSide], y[ySide], z[zSide], cornerDirection, cornerBlockage);
+
+		directionX += cornerDirection.getX() * weight;
+		directionY += cornerDirection.getY() * weight;
+		directionZ += cornerDirection.getZ() * weight;
+		blockage += cornerBlockage * weight;
+	}
+
+	CVect blended(directionX, directionY, directionZ);
+
+	// Only possible if the surrounding units point in exactly opposite directions.  The containing unit decides
+	if (blended.getMag() == 0.) {
+
+		double unusedBlockage;
+		int xInd, yInd, zInd;
+		this->findUnitIndices(meriLoc, xInd, yInd, zInd);
+		this->unitQueryResult(xInd, yInd, zInd, chosenDirection, unusedBlockage);
+		return;
+	}
+
+	chosenDirection = blended.resized(1.);
+}
+
+void BlockPointGrid::interpolationIndices(double units, int elements, int indices[2], double &weight) {
+
+	double lower = std::floor(units);
+	weight = units - lower;
+	indices[0] = std::min(std::max(int(lower), 0), elements - 1);
+	indices[1] = std::min(std::max(int(lower) + 1, 0), elements - 1);
+}
+
+bool BlockPointGrid::cachedQueryResult(int x, int y, int z, CVect &chosenDirection, double &blockage) const {
+
+	if (coarseLevelsChanged)
+		return false;
+
+	if (packedQueryCache) {
+
+		const PackedQuery *query;
+		if (sparseStorage) {
+
+			const PackedQuery *row = sparsePackedRows[x * yElements + y].get();
+			if (!row)
+				return false;
+
+			query = row + z;
+		}
+		else if (!packedQueries.empty())
+			query = &packedQueries[unitIndex(x, y, z)];
+		else
+			return false;
+
+		if (query->blockage == outdatedPackedQuery().blockage)
+			return false;
+
+		chosenDirection = CVect(query->directionX / 32767., query->directionY / 32767., query->directionZ / 32767.);
+		blockage = query->blockage / 65534.;
+		PHOT_STAT(count(statCounters.cachedQueries));
+		return true;
+	}
+
+	const double *directionX, *directionY, *directionZ, *unitBlockage;
+	std::size_t i = z;
+
+	if (sparseStorage) {
+
+		const double *cache = sparseCacheRows[x * yElements + y].get();
+		if (!cache)
+			return false;
+
+		directionX = cache;
+		directionY = cache + zElements;
+		directionZ = cache + 2 * zElements;
+		unitBlockage = cache + 3 * zElements;
+	}
+	else {
+
+		if (cachedBlockage.empty())
+			return false;
+
+		directionX = cachedDirectionX.data();
+		directionY = cachedDirectionY.data();
+		directionZ = cachedDirectionZ.data();
+		unitBlockage = cachedBlockage.data();
+		i = unitIndex(x, y, z);
+	}
+
+	if (std::isnan(unitBlockage[i]))
+		return false;
+
+	chosenDirection.set(directionX[i], directionY[i], directionZ[i], 1.);
+	blockage = unitBlockage[i];
+	PHOT_STAT(count(statCounters.cachedQueries));
+	return true;
+}
+
+void BlockPointGrid::refreshQueryCache() {
+
+	PHOT_STAT(count(statCounters.cacheRefreshes));
+	PHOT_STAT(StatTimer timer(statCounters.cacheRefreshNanoseconds));
+
+	this->allocateDenseQueryCache();
+
+	std::atomic<int> nextX(0);
+
+	// Each thread takes one x index (a plane of units) at a time
+	auto refreshPlanes = [&]() {
+
+		CVect chosenDirection(0., 0., 0., 0.);
+		double blockage;
+
+		for (int x = nextX++; x < xElements; x = nextX++) {
+
+			for (int y = 0; y < yElements; ++y) {
+
+				if (sparseStorage) {
+
+					if (!sparseRows[x * yElements + y])
+						continue;
+
+					// Each row is only refreshed by one thread, so its cache can be allocated here without locking
+					this->allocateSparseQueryCache(std::size_t(x) * yElements + y);
+				}
+
+				UnitRun row = this->writableRow(x, y);
+				for (int z = 0; z < zElements; ++z) {
+
+					if (row.packedQueries) {
+
+						if (!coarseLevelsChanged && row.packedQueries[z].blockage != outdatedPackedQuery().blockage)
+							continue;
+
+						this->queryResult(this->storedLightDirection(x, y, z), this->unitBlockage(x, y, z), chosenDirection, blockage);
+						row.packedQueries[z] = packQuery(chosenDirection, blockage);
+						continue;
+					}
+
+					if (!coarseLevelsChanged && !std::isnan(row.cachedBlockage[z]))
+						continue;
+
+					this->queryResult(this->storedLightDirection(x, y, z), this->unitBlockage(x, y, z), chosenDirection, blockage);
+					row.cachedDirectionX[z] = chosenDirection.getX();
+					row.cachedDirectionY[z] = chosenDirection.getY();
+					row.cachedDirectionZ[z] = chosenDirection.getZ();
+					row.cachedBlockage[z] = blockage;
+				}
+			}
+		}
+	};
+
+	this->runOnThreads(xElements, refreshPlanes);
+
+	coarseLevelsChanged = false;
+}
+
+void GridStats::writeJSON(std::ostream &out) const {
+
+	out << "{\n\t\"collected\": " << (collected ? "true" : "false");
+#define PHOT_GRID_STAT_JSON(name) out << ",\n\t\"" #name "\": " << name;
+	PHOT_GRID_STAT_TABLE(PHOT_GRID_STAT_JSON)
+#undef PHOT_GRID_STAT_JSON
+
+	out << "\n}\n";
+}
+
+GridStats BlockPointGrid::getStats() const {
+
+	GridStats stats;
+
+#ifdef PHOT_GRID_STATS
+	stats.collected = true;
+#define PHOT_GRID_STAT_LOAD(name) stats.name = statCounters.name.load(std::memory_order_relaxed);
+	PHOT_GRID_STAT_TABLE(PHOT_GRID_STAT_LOAD)
+#undef PHOT_GRID_STAT_LOAD
+#endif
+
+	return stats;
+}
+
+void BlockPointGrid::resetStats() {
+
+#ifdef PHOT_GRID_STATS
+#define PHOT_GRID_STAT_RESET(name) statCounters.name.store(0, std::memory_order_relaxed);
+	PHOT_GRID_STAT_TABLE(PHOT_GRID_STAT_RESET)
+#undef PHOT_GRID_STAT_RESET
+#endif
+}
+
+
 bool BlockPointGrid::indicesAreInRange(int x, int y, int z) const {
 
 	if (x >= xElements || x < 0)
@@ -361,17 +2238,17 @@ bool BlockPointGrid::indicesAreInRange_showError(int x, int y, int z) const {
 
 	if (x >= xElements || x < 0) {
 
-		MStreamUtils::stdOutStream() << "Error. x index outside of grid.\nAborting\n";
+		photLog() << "Error. x index outside of grid.\nAborting\n";
 		return false;
 	}
 	else if (y >= yElements || y < 0) {
 
-		MStreamUtils::stdOutStream() << "Error. y index outside of grid.\nAborting\n";
+		photLog() << "Error. y index outside of grid.\nAborting\n";
 		return false;
 	}
 	else if (z >= zElements || z < 0) {
 
-		MStreamUtils::stdOutStream() << "Error. z index outside of grid.\nAborting\n";
+		photLog() << "Error. z index outside of grid.\nAborting\n";
 		return false;
 	}
 
@@ -381,7 +2258,7 @@ bool BlockPointGrid::indicesAreInRange_showError(int x, int y, int z) const {
 void BlockPointGrid::addBlockPointsThroughGridLevels(int xMin, int xMax, int yMin, int yMax, int zMin, int zMax) {
 
 	if (!indicesAreInRange(xMin, yMin, zMin) || !indicesAreInRange(xMax, yMax, zMax)) {
-		MStreamUtils::stdOutStream() << "Indices are out of range for adding block points\n";
+		photLog() << "Indices are out of range for adding block points\n";
 		return;
 	}
 
@@ -392,7 +2269,7 @@ void BlockPointGrid::addBlockPointsThroughGridLevels(int xMin, int xMax, int yMi
 			for (int zI = zMin; zI <= zMax; ++zI) {
 
 				BlockPoint *dummyPtr;
-				this->addBlockPoint(grid[xI][yI][zI].center, 1., dummyPtr);
+				this->addBlockPoint(unitCenter(xI, yI, zI), 1., dummyPtr);
 			}
 		}
 	}
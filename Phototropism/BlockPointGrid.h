@@ -15,14 +15,31 @@ is determined by the members, coneRangeAngle and detectionRange.
 #ifndef BlockPointGrid_h
 #define BlockPointGrid_h
 
+#include <algorithm>
 #include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
 #include <vector>
 
-#include <maya/MStreamUtils.h>
-#include <maya/MStatus.h>
-
+#include "PhotLog.h"
 #include "PhotMath.h"
-#include "MeshMaker.h"
+#include "ConeKernels.h"
+#include "WorkerPool.h"
+
+// Statistics are only kept when the core is built with PHOT_GRID_STATS defined (see CMakeLists.txt).  Otherwise PHOT_STAT()
+// statements are removed, and keeping statistics costs nothing
+#ifdef PHOT_GRID_STATS
+#include <atomic>
+#include <chrono>
+#define PHOT_STAT(statement) statement
+#else
+#define PHOT_STAT(statement)
+#endif
 
 struct BlockPoint {
 
@@ -32,6 +49,14 @@ struct BlockPoint {
 	int gridY;
 	int gridZ;
 
+	// Where the BlockPoint is held by its grid (see BlockPointHandle).  A slot is reused once its BlockPoint is removed, and
+	// generation counts how many times that has happened
+	std::uint32_t slot = 0;
+	std::uint32_t generation = 0;
+	bool live = false;
+
+	BlockPoint() : density(0.), gridX(0), gridY(0), gridZ(0) {}
+
 	BlockPoint(const Point &LOC, double DENSITY, int GX, int GY, int GZ) : loc(LOC), density(DENSITY), gridX(GX), gridY(GY), gridZ(GZ) {}
 
 	void changeGridUnit(int GX, int GY, int GZ) {
@@ -42,36 +67,71 @@ struct BlockPoint {
 	}
 };
 
-class BlockPointGrid {
+// Identifies a BlockPoint held by a BlockPointGrid.  Unlike a pointer, a handle can safely outlive its BlockPoint: once the
+// BlockPoint is removed, the grid no longer recognizes the handle, even if the BlockPoint's slot is reused
+struct BlockPointHandle {
 
-	struct Unit {
+	std::uint32_t slot = ~std::uint32_t(0);
+	std::uint32_t generation = 0;
 
-		// A vector indicating the direction towards the most light
-		Point lightDirection;
+	bool operator==(const BlockPointHandle &rhs) const { return slot == rhs.slot && generation == rhs.generation; }
 
-		// A percentage indicating how much light the unit is blocking.  1 means it is blocking 100%, 0 means 0%.
-		/* A unit's density is the sum of the densities of all block points in it.  While it can hold any number, it is effectively never
-		   greater than one nor less than zero.  This is enforced in addBlockPoint() and moveBlockPoint().  The reason we don't clamp the
-		   values between 1 and 0 when storing in this variable is that we need to be able to subtract block points' densities in the future,
-		   which, if density were capped at 1, would lead to negative/inaccurate density values since there can be many block points in a unit.
-		   Another way to handle this would be to store a separate variable for the full density value */
-		double density = 0.;
-
-		// A percentage indicating how much light is blocked from the unit.  At 1, any meristems in the unit receive no energy from light.
-		double blockage = 0.;
-
-		Point center;
+	bool operator!=(const BlockPointHandle &rhs) const { return !(*this == rhs); }
+};
 
-		Unit(double cX, double cY, double cZ, double ldX, double ldY, double ldZ) {
+// Every stat a BlockPointGrid keeps, in the order they are written.  Each STAT(name) becomes a GridStats member, a counter
+// behind it and an entry in GridStats::writeJSON(), so a stat is added here and nowhere else:
+//  adjustGridCalls, adjustGridNanoseconds: changes to the density of a single unit, made for a single BlockPoint (see
+//   BlockPointGrid::adjustGrid()), and the time spent on them, including applying their cones
+//  batchUpdates, batchUpdateNanoseconds: batches of density changes (see BlockPointGrid::applyDensityAdjustments()), and the
+//   time spent on them
+//  unchangedDensityUpdates: changes to a unit's density that left its effective (clamped) density the same, so no cone was
+//   applied
+//  saturatedUpdates: changes to the density of a full unit that left it full.  These are made to the unit's density as soon
+//   as they are asked for, without being batched, and are not counted in unchangedDensityUpdates
+//  sameUnitMoves: moves that left the BlockPoint in the same unit
+//  stencilMoves: moves to a neighboring unit that were applied with a shift stencil (see BlockPointGrid::setShiftStencils()).
+//   Each stencil applied also counts in conesApplied
+//  conesApplied, coneEntriesApplied, coneEntriesClipped, coarseEntriesApplied: cones and stencils applied, their full
+//   resolution entries that were applied to units, those that fell off the grid and were skipped, and the entries applied
+//   to coarse levels
+//  queries, cachedQueries, queryNanoseconds: locations queried, whether one at a time or in batches, those answered from
+//   the query cache, and the time spent on them.  Batches are timed as a whole
+//  cacheRefreshes, cacheRefreshNanoseconds: calls to BlockPointGrid::refreshQueryCache(), and the time spent on them
+#define PHOT_GRID_STAT_TABLE(STAT) \
+	STAT(adjustGridCalls) \
+	STAT(adjustGridNanoseconds) \
+	STAT(batchUpdates) \
+	STAT(batchUpdateNanoseconds) \
+	STAT(unchangedDensityUpdates) \
+	STAT(saturatedUpdates) \
+	STAT(sameUnitMoves) \
+	STAT(stencilMoves) \
+	STAT(conesApplied) \
+	STAT(coneEntriesApplied) \
+	STAT(coneEntriesClipped) \
+	STAT(coarseEntriesApplied) \
+	STAT(queries) \
+	STAT(cachedQueries) \
+	STAT(queryNanoseconds) \
+	STAT(cacheRefreshes) \
+	STAT(cacheRefreshNanoseconds)
+
+// Counts and times of a BlockPointGrid's work since it was created or its stats were reset (see BlockPointGrid::getStats())
+struct GridStats {
+
+	// Whether the core was built to keep stats.  If not, everything below is zero
+	bool collected = false;
+
+#define PHOT_GRID_STAT_MEMBER(name) std::uint64_t name = 0;
+	PHOT_GRID_STAT_TABLE(PHOT_GRID_STAT_MEMBER)
+#undef PHOT_GRID_STAT_MEMBER
+
+	// Writes the stats as a JSON object
+	void writeJSON(std::ostream &out) const;
+};
 
-			center.x = cX;
-			center.y = cY;
-			center.z = cZ;
-			lightDirection.x = ldX;
-			lightDirection.y = ldY;
-			lightDirection.z = ldZ;
-		}
-	};
+class BlockPointGrid {
 
 	struct IndexVector {
 
@@ -89,12 +149,202 @@ class BlockPointGrid {
 			blockageVect(TRUEVECT), blockageStrength(BLOCKAGESTRENGTH) {}
 	};
 
+	// A run of units in the cone that share x and y offsets and have consecutive z offsets.  Since z is the innermost dimension
+	// of the unit arrays, the units of a run are adjacent in memory
+	struct ConeRun {
+
+		int x;
+		int y;
+		int zStart;
+		int length;
+
+		// Added to the unit index of the unit doing the affecting to get the unit index of the first unit in the run
+		int offset;
+
+		// The index of the run's first entry in the cone weight arrays (Cone::lightX, etc.)
+		int firstEntry;
+
+		ConeRun(int X, int Y, int ZSTART, int OFFSET, int FIRSTENTRY) : x(X), y(Y), zStart(ZSTART), length(1), offset(OFFSET),
+			firstEntry(FIRSTENTRY) {}
+	};
+
+	// Index vectors compiled for applying to a grid (see compileCone()).  The runs cover every index vector in order, and the
+	// weight arrays hold each index vector's blockageVect components and blockageStrength at the same position
+	struct Cone {
+
+		std::vector<ConeRun> runs;
+		std::vector<double> lightX;
+		std::vector<double> lightY;
+		std::vector<double> lightZ;
+		std::vector<double> strength;
+
+		// The smallest and largest index vector components.  When a unit is at least this far from the borders of the grid, the
+		// whole cone fits on the grid and no index needs to be checked
+		int minX = 0;
+		int maxX = 0;
+		int minY = 0;
+		int maxY = 0;
+		int minZ = 0;
+		int maxZ = 0;
+	};
+
+	// A copy of the grid at a coarser resolution, which takes the far part of the cone (see setCoarseLevels()).  Each of its units
+	// covers 2^shift units of the grid on each axis, and holds the sum of the changes the level's cone made to those units
+	struct CoarseLevel {
+
+		int shift;
+		int xElements;
+		int yElements;
+		int zElements;
+		Cone cone;
+		std::vector<double> blockage;
+		std::vector<double> lightX;
+		std::vector<double> lightY;
+		std::vector<double> lightZ;
+
+		std::size_t unitIndex(int x, int y, int z) const { return (std::size_t(x) * yElements + y) * zElements + z; }
+	};
+
+	// A unit's query results in 8 bytes rather than 32 (see setPackedQueryCache()).  The direction's components are stored as
+	// multiples of 1/32767, and the blockage as a multiple of 1/65534, clamped to [0, 1].  A blockage of 65535 marks the entry as
+	// out of date
+	struct PackedQuery {
+
+		std::int16_t directionX;
+		std::int16_t directionY;
+		std::int16_t directionZ;
+		std::uint16_t blockage;
+	};
+
+	// Pointers to the data of consecutive units along the z axis.  Indexing any member with n gives the data of the nth unit
+	// The query cache is either in the four cached arrays or in packedQueries, and the other pointers are null.  All of them are
+	// null until the units' cache is allocated.  Likewise, blockage and light are either in the four doubles or, with float
+	// storage, in the four floats
+	struct UnitRun {
+
+		double *density;
+		double *blockage;
+		double *lightX;
+		double *lightY;
+		double *lightZ;
+		double *cachedDirectionX;
+		double *cachedDirectionY;
+		double *cachedDirectionZ;
+		double *cachedBlockage;
+		PackedQuery *packedQueries;
+		float *floatBlockage;
+		float *floatLightX;
+		float *floatLightY;
+		float *floatLightZ;
+
+		// The same units, starting n units further along
+		UnitRun operator+(int n) const {
+
+			auto advance = [n](auto *data) { return data ? data + n : data; };
+
+			return { advance(density), advance(blockage), advance(lightX), advance(lightY), advance(lightZ), advance(cachedDirectionX),
+				advance(cachedDirectionY), advance(cachedDirectionZ), advance(cachedBlockage), advance(packedQueries),
+				advance(floatBlockage), advance(floatLightX), advance(floatLightY), advance(floatLightZ) };
+		}
+	};
+
 	enum adjustment { add = 1, subtract = -1 };
 
+	// A unit whose effective density changed, and whose cone still needs to be updated
+	struct ConeUpdate {
+
+		int x;
+		int y;
+		int z;
+		double densityChange;
+
+		ConeUpdate(int X, int Y, int Z, double DENSITYCHANGE) : x(X), y(Y), z(Z), densityChange(DENSITYCHANGE) {}
+	};
+
+	// One location passed to getDirectionsAndBlockages(), with the indices of its unit and its position in the batch
+	struct MeristemQuery {
+
+		std::size_t unit;
+		int x;
+		int y;
+		int z;
+		std::size_t position;
+
+		MeristemQuery(std::size_t UNIT, int X, int Y, int Z, std::size_t POSITION) : unit(UNIT), x(X), y(Y), z(Z), position(POSITION) {}
+
+		bool operator<(const MeristemQuery &rhs) const { return unit < rhs.unit; }
+	};
+
+	// A change to the density of one unit, waiting to be applied along with others
+	struct DensityAdjustment {
+
+		std::size_t unit;
+		double amount;
+
+		DensityAdjustment(std::size_t UNIT, double AMOUNT) : unit(UNIT), amount(AMOUNT) {}
+
+		bool operator<(const DensityAdjustment &rhs) const { return unit < rhs.unit; }
+	};
+
 	// We want the grid to be represented as centered on the Maya grid.  This means that x and z elements must always be an odd
 	// number.  E.g. xSize / xUnitSize is always an odd number.  Also, this means that the center element itself is centered on
 	// the Maya grid.  E.g. the x and z coordinates at the center of the center element are 0. and 0.
-	std::vector< std::vector< std::vector<Unit> > > grid;
+
+	// The units' data is stored as parallel arrays, each holding one entry per unit at the index given by unitIndex().  Keeping each
+	// attribute in its own contiguous array means that adjusting the grid only pulls in the data it actually changes.  Unit centers
+	// are not stored since they can be calculated from the indices (see unitCenter())
+
+	// A percentage indicating how much light the unit is blocking.  1 means it is blocking 100%, 0 means 0%.
+	/* A unit's density is the sum of the densities of all block points in it.  While it can hold any number, it is effectively never
+	   greater than one nor less than zero.  This is enforced in addBlockPoint() and moveBlockPoint().  The reason we don't clamp the
+	   values between 1 and 0 when storing in this variable is that we need to be able to subtract block points' densities in the future,
+	   which, if density were capped at 1, would lead to negative/inaccurate density values since there can be many block points in a unit.
+	   Another way to handle this would be to store a separate variable for the full density value */
+	std::vector<double> density;
+
+	// A percentage indicating how much light is blocked from the unit.  At 1, any meristems in the unit receive no energy from light.
+	std::vector<double> blockage;
+
+	// The components of a vector indicating the direction towards the most light
+	std::vector<double> lightX;
+	std::vector<double> lightY;
+	std::vector<double> lightZ;
+
+	// When true, blockage and light are stored in the float arrays below instead, and the double arrays above are left empty
+	// (see setFloatStorage())
+	bool floatStorage = false;
+
+	std::vector<float> floatBlockage;
+	std::vector<float> floatLightX;
+	std::vector<float> floatLightY;
+	std::vector<float> floatLightZ;
+
+	// What getDirectionAndBlockage() gives for each unit: its light direction resized to 1, and its blockage divided by
+	// maximumBlockage.  Changing a unit sets its cachedBlockage to NaN, marking its entries as out of date until
+	// refreshQueryCache() recomputes them.  A dense grid's cache is only allocated by the first refresh, so grids that are
+	// never queried through it do not spend 32 bytes per unit on it.  Until then the arrays are empty and every query misses
+	std::vector<double> cachedDirectionX;
+	std::vector<double> cachedDirectionY;
+	std::vector<double> cachedDirectionZ;
+	std::vector<double> cachedBlockage;
+
+	// When true, the query cache is held in packedQueries instead of the four arrays above, which are left empty
+	bool packedQueryCache = false;
+
+	std::vector<PackedQuery> packedQueries;
+
+	// When true, the arrays above are left empty and units are stored in rows (all units sharing x and y indices) that are only
+	// allocated when one of their units is first changed.  Units in rows that have not been allocated are unblocked: they have
+	// no density or blockage, and their light direction is maximumLightVector
+	bool sparseStorage = false;
+
+	// Used when sparseStorage is true, indexed by (x * yElements + y).  Each allocated row holds density, blockage, lightX, lightY
+	// and lightZ, each zElements long.  As with a dense grid, a row's query cache is only allocated by the first refresh after the
+	// row is: in sparseCacheRows as cachedDirectionX, cachedDirectionY, cachedDirectionZ and cachedBlockage, or with a packed
+	// query cache in sparsePackedRows.  Until then every query of the row misses
+	std::vector< std::unique_ptr<double[]> > sparseRows;
+	std::vector< std::unique_ptr<double[]> > sparseCacheRows;
+	std::vector< std::unique_ptr<PackedQuery[]> > sparsePackedRows;
 
 	double unitSize;
 	int xElements;
@@ -118,22 +368,378 @@ class BlockPointGrid {
 	// to access each unit affected by the block point.  That is, each index vector points to one of the units within the cone effected by the block point
 	std::vector<IndexVector> indexVectorsToUnitsInCone;
 
+	// indexVectorsToUnitsInCone compiled for adjustGrid().  With coarse levels, only the index vectors nearer than the first
+	// level's range
+	Cone cone;
+
+	// The far parts of the cone, from nearest to farthest, each at half the resolution of the one before
+	std::vector<CoarseLevel> coarseLevels;
+
+	// When true, a BlockPoint moving to a neighboring unit updates the grid with one pass over a difference stencil rather than
+	// subtracting one cone and adding another (see setShiftStencils())
+	bool useShiftStencils = false;
+
+	// For each shift to a neighboring unit, the cone at the new unit minus the cone at the old one, relative to the old unit.
+	// Indexed by shiftStencilIndex().  Empty unless useShiftStencils is set, and a shift's stencil has no runs when it would not
+	// be cheaper than the two cones
+	std::vector<Cone> shiftStencils;
+
+	// Set when the grid changes while it has coarse levels.  A coarse unit's change affects many units, so rather than marking
+	// each of them, the whole query cache is treated as out of date until refreshQueryCache()
+	bool coarseLevelsChanged = false;
+
 	// maximumBlockage represents the total number of units within detectionRange at full density
 	double maximumBlockage = 0.;
 	Point maximumLightVector = { 0.,0.,0. };
 
-	std::vector<BlockPoint*> bps;
+	// The magnitude of maximumLightVector.  Every unit's lightDirection is kept at this length
+	double maximumLightMagnitude = 0.;
+
+	// Applies runs of the cone to the grid.  Chosen at construction to suit the processor
+	ConeKernel coneKernel = applyConeScalar;
+
+	// Applies runs of the cone to a grid with float storage
+	FloatConeKernel floatConeKernel = accumulateConeFloatScalar;
+
+	// When true, units' light directions are not resized after each change.  They hold the raw sum of maximumLightVector and
+	// every change applied to them, and are only resized when read (see unitLightDirection() and getDirectionAndBlockage())
+	bool deferLightNormalization = false;
+
+	// When true, the grid is kept on a fixed-point lattice so that every change is added exactly (see setExactAccumulation())
+	bool exactAccumulation = false;
+
+	// With exact accumulation, BlockPoint densities are rounded to multiples of densityQuantum, and the cone's weights and
+	// maximumLightVector to multiples of weightQuantum
+	static const int densityQuantumBits = 20;
+	double weightQuantum = 0.;
+
+	// The number of threads batch updates may use (see applyConeUpdates())
+	int threadCount = 1;
+
+	// Runs work on threadCount threads.  Only exists when threadCount is more than 1
+	std::unique_ptr<WorkerPool> workerPool;
+
+	// When true, queries blend the 8 surrounding units rather than using the unit containing the meristem
+	bool interpolateQueries = false;
+
+	// The kinds of record in an event log (see BlockPointGrid_events.cpp).  Each change to the grid is logged with a record of
+	// the same kind as the call that made it, so that replaying can make the same call
+	enum class GridEvent : std::uint8_t {
+		kAdd, kAddBatch, kMove, kMoveBatch, kRemove, kRemoveBatch, kSetDensity, kSetDensityBatch, kSetIntensity, kSetConeRangeAngle,
+		kSetDetectionRange, kRecompute
+	};
+
+#ifdef PHOT_GRID_STATS
+
+	// The counters behind GridStats, one for each entry of PHOT_GRID_STAT_TABLE.  Cones are applied and queries answered by
+	// several threads at once, so counters are atomic
+	struct StatCounters {
+
+#define PHOT_GRID_STAT_COUNTER(name) std::atomic<std::uint64_t> name{ 0 };
+		PHOT_GRID_STAT_TABLE(PHOT_GRID_STAT_COUNTER)
+#undef PHOT_GRID_STAT_COUNTER
+	};
+
+	mutable StatCounters statCounters;
+
+	// The order between counters does not matter, only their totals
+	static void count(std::atomic<std::uint64_t> &counter, std::uint64_t amount = 1) {
+
+		counter.fetch_add(amount, std::memory_order_relaxed);
+	}
+
+	// Adds the time from its creation to its destruction to a counter
+	class StatTimer {
+
+		std::atomic<std::uint64_t> &nanoseconds;
+		std::chrono::steady_clock::time_point start;
+
+	public:
+
+		StatTimer(std::atomic<std::uint64_t> &NANOSECONDS) : nanoseconds(NANOSECONDS), start(std::chrono::steady_clock::now()) {}
+
+		~StatTimer() {
+
+			count(nanoseconds, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+		}
+	};
+
+#endif
+
+	// While events are being logged, the stream records are appended to
+	std::unique_ptr<std::ostream> eventLog;
+
+	// Appends the start of a record for count changes.  The entries follow, each written with logHandle() and logValue()
+	void logEventStart(GridEvent event, std::uint32_t count);
+
+	void logHandle(const BlockPointHandle &handle);
+
+	void logValue(double value);
+
+	// The BlockPoints are held in chunks of 2^blockPointChunkShift slots.  Chunks are never moved or freed while the grid
+	// exists, so a pointer to a BlockPoint stays valid until the BlockPoint is removed.  Removed BlockPoints' slots are kept in
+	// freeBlockPointSlots and reused before new ones.  Everything is freed along with the grid
+	static const int blockPointChunkShift = 12;
+	std::vector< std::unique_ptr<BlockPoint[]> > blockPointChunks;
+
+	// The number of slots that have ever held a BlockPoint.  Slots from here to the end of the last chunk are unused
+	std::uint32_t blockPointSlots = 0;
+
+	std::vector<std::uint32_t> freeBlockPointSlots;
+
+	std::size_t liveBlockPoints = 0;
+
+	BlockPoint &blockPointInSlot(std::uint32_t slot) const {
+
+		return blockPointChunks[slot >> blockPointChunkShift][slot & ((1u << blockPointChunkShift) - 1)];
+	}
+
+	// Places a new BlockPoint in a free slot
+	BlockPoint *allocateBlockPoint(const Point &loc, double bpDensity, int x, int y, int z);
+
+	// Frees the BlockPoint's slot, making any handles to it out of date.  Does not change the grid
+	void releaseBlockPoint(BlockPoint *bp);
 
 	void initiateGrid();
 
+	// z is the innermost dimension, so units that differ only by their z index are adjacent in memory.  A sparse grid can have
+	// more units than an int can count, so unit indices are std::size_t
+	std::size_t unitIndex(int x, int y, int z) const { return (std::size_t(x) * yElements + y) * zElements + z; }
+
+	// The reverse of unitIndex()
+	void unitIndices(std::size_t i, int &x, int &y, int &z) const {
+
+		z = int(i % zElements);
+		y = int((i / zElements) % yElements);
+		x = int(i / (std::size_t(zElements) * yElements));
+	}
+
+	// Finds the indices of the unit containing loc.  The indices may be out of range
+	void findUnitIndices(const Point &loc, int &x, int &y, int &z) const {
+
+		x = int(std::floor((loc.x + halfGridXSize) / unitSize));
+		y = int(std::floor(loc.y / unitSize));
+		z = int(std::floor((loc.z + halfGridZSize) / unitSize));
+	}
+
+	Point unitCenter(int x, int y, int z) const;
+
+	// The unit's light direction, resized to the magnitude of maximumLightVector
+	Point unitLightDirection(int x, int y, int z) const;
+
+	// The unit's light direction as stored, which may not be resized if normalization is deferred
+	Point storedLightDirection(int x, int y, int z) const;
+
+	double unitDensity(int x, int y, int z) const;
+
+	double unitBlockage(int x, int y, int z) const;
+
+	// The data of the units in the dense arrays, starting at unit index i
+	UnitRun denseRun(std::size_t i) {
+
+		UnitRun run = {};
+		run.density = &density[i];
+
+		if (floatStorage) {
+
+			run.floatBlockage = &floatBlockage[i];
+			run.floatLightX = &floatLightX[i];
+			run.floatLightY = &floatLightY[i];
+			run.floatLightZ = &floatLightZ[i];
+		}
+		else {
+
+			run.blockage = &blockage[i];
+			run.lightX = &lightX[i];
+			run.lightY = &lightY[i];
+			run.lightZ = &lightZ[i];
+		}
+
+		if (!packedQueries.empty())
+			run.packedQueries = &packedQueries[i];
+		else if (!cachedBlockage.empty()) {
+
+			run.cachedDirectionX = &cachedDirectionX[i];
+			run.cachedDirectionY = &cachedDirectionY[i];
+			run.cachedDirectionZ = &cachedDirectionZ[i];
+			run.cachedBlockage = &cachedBlockage[i];
+		}
+
+		return run;
+	}
+
+	static double outdated() { return std::numeric_limits<double>::quiet_NaN(); }
+
+	static PackedQuery outdatedPackedQuery() { return { 0, 0, 0, 0xFFFF }; }
+
+	static PackedQuery packQuery(const CVect &chosenDirection, double blockage) {
+
+		return { std::int16_t(std::lround(chosenDirection.getX() * 32767.)), std::int16_t(std::lround(chosenDirection.getY() * 32767.)),
+			std::int16_t(std::lround(chosenDirection.getZ() * 32767.)),
+			std::uint16_t(std::lround(std::min(std::max(blockage, 0.), 1.) * 65534.)) };
+	}
+
+	// Marks the query cache of count consecutive units as out of date
+	static void outdateQueries(const UnitRun &units, int count);
+
+	// Frees the query cache of every unit.  It is allocated again, in the form packedQueryCache calls for, by
+	// allocateDenseQueryCache() or allocateSparseQueryCache()
+	void reallocateQueryCache();
+
+	// Allocates a dense grid's query cache, out of date, if it has not been since the last reallocateQueryCache()
+	void allocateDenseQueryCache();
+
+	// Allocates the query cache of an allocated sparse row, out of date, if the row has none
+	void allocateSparseQueryCache(std::size_t row);
+
+	// Computes the query results of a unit with the given stored light direction and blockage
+	void queryResult(const Point &lightDirection, double unitBlockage, CVect &chosenDirection, double &blockage) const {
+
+		chosenDirection = CVect(lightDirection).resized(1.);
+		blockage = unitBlockage / maximumBlockage;
+	}
+
+	// Calls work() on up to threads of the grid's threads at once (see WorkerPool::run())
+	void runOnThreads(std::size_t threads, const std::function<void()> &work) const;
+
+	// Calls work(first, last) for contiguous shares of the range [0, count), sharing them between up to threadCount threads
+	void splitBetweenThreads(std::size_t count, const std::function<void(std::size_t, std::size_t)> &work) const;
+
+	// Gives the query results of the unit, from the cache if it is up to date
+	void unitQueryResult(int x, int y, int z, CVect &chosenDirection, double &blockage) const;
+
+	// Blends the query results of the 8 units whose centers surround meriLoc, weighted by closeness on each axis
+	void interpolatedQueryResult(const Point &meriLoc, CVect &chosenDirection, double &blockage) const;
+
+	// For a coordinate measured in units from the center of the first unit on an axis, gives the indices of the unit centers
+	// on either side of it, clamped to the grid, and the weight of the second
+	static void interpolationIndices(double units, int elements, int indices[2], double &weight);
+
+	// Gives the cached query results of the unit.  Returns false if they are out of date
+	bool cachedQueryResult(int x, int y, int z, CVect &chosenDirection, double &blockage) const;
+
+	// The data of the row of units with indices x and y, starting at z = 0.  With sparse storage, the row is allocated if needed
+	UnitRun writableRow(int x, int y);
+
+	// recomputeGrid() without logging, for the functions that use it
+	void rebuildGrid();
+
+	// Sets every unit's light direction and blockage, and those of the coarse levels, to their unblocked state
+	void resetLightField();
+
+	// Sets every unit's light direction and blockage to maximumLightVector and 0 plus the sums of the cones of the occupied units,
+	// computed as a convolution (see BlockPointGrid_convolution.cpp).  Returns false without changing the grid if the grid
+	// has sparse storage or coarse levels, or if convolving would cost more than applying the cones
+	bool convolveGrid(const std::vector<ConeUpdate> &occupied);
+
+	// Transforms values, a grid of size[0] * size[1] * size[2] values, each a power of two, in place, using up to threadCount
+	// threads.  The inverse transform is not divided by the number of values
+	void fourierTransform(std::vector< std::complex<double> > &values, const int size[3], bool inverse) const;
+
 	// Establishes indexVectorsToUnitsInCone, maximumBlockage, and maximumLightVector
 	void setIndexVectorsAndMaximums();
 
+	// Chooses weightQuantum and rounds the weights of indexVectorsToUnitsInCone and maximumLightVector to multiples of it
+	void quantizeWeights();
+
+	// The density a BlockPoint is given, which is rounded to a multiple of densityQuantum with exact accumulation
+	double storedDensity(double bpDensity) const {
+
+		return exactAccumulation ? std::ldexp(std::round(std::ldexp(bpDensity, densityQuantumBits)), -densityQuantumBits) : bpDensity;
+	}
+
+	// Compiles indexVects, which must be ordered with z as the innermost loop, for a grid with the given number of elements
+	static void compileCone(const std::vector<IndexVector> &indexVects, int yElements, int zElements, Cone &cone);
+
+	// Builds cone and coarseLevels from indexVectorsToUnitsInCone, with levelCount coarse levels
+	// pre: setIndexVectorsAndMaximums() has been called and the number of elements on each axis is set
+	void compileCones(int levelCount);
+
+	// Builds shiftStencils from the index vectors compiled into cone, if useShiftStencils is set
+	void compileShiftStencils(const std::vector<IndexVector> &indexVects);
+
+	// The position in shiftStencils of the stencil for a move of (dx, dy, dz) units, or -1 if the move is not to a neighboring unit
+	static int shiftStencilIndex(int dx, int dy, int dz) {
+
+		if (std::abs(dx) > 1 || std::abs(dy) > 1 || std::abs(dz) > 1 || (dx == 0 && dy == 0 && dz == 0))
+			return -1;
+
+		return ((dx + 1) * 3 + dy + 1) * 3 + dz + 1;
+	}
+
+	bool coneFitsOnGrid(const Cone &source, int x, int y, int z) const {
+
+		return x + source.minX >= 0 && x + source.maxX < xElements && y + source.minY >= 0 && y + source.maxY < yElements &&
+			z + source.minZ >= 0 && z + source.maxZ < zElements;
+	}
+
+	// A change for every unit with density, equal to its effective (clamped) density, in order of unit index
+	std::vector<ConeUpdate> occupiedUnits() const;
+
+	void markQueryCacheOutdated();
+
+	// Rebuilds indexVectorsToUnitsInCone, the maximums and the compiled cones after a parameter of the cone has changed
+	void rebuildCone();
+
+	// Applies the level's cone for a change in the density of the grid unit at (x, y, z)
+	void applyCoarseCone(CoarseLevel &level, int x, int y, int z, double densityChange);
+
+	// The size on each axis of the tiles used by applyConeUpdates().  Large enough that the cones of units in two tiles that are
+	// not next to each other on an axis never overlap on any level
+	void tileSize(int &x, int &y, int &z) const;
+
+	// Allocates the sparse rows that applyConeRuns() would for source placed at the unit at (x, y, z)
+	void allocateRowsInCone(const Cone &source, int x, int y, int z);
+
+	// Adds the weights of count consecutive entries of source, multiplied by densityChange, to count consecutive units
+	void applyConeEntries(const Cone &source, const UnitRun &units, int firstEntry, int count, double densityChange);
+
+	// Applies every entry of source, placed at the unit at (x, y, z), that falls on the full resolution grid
+	void applyConeRuns(const Cone &source, int x, int y, int z, double densityChange);
+
+	// Applies a change in the density of the unit at (x, y, z) to every unit in its cone
+	void applyCone(int x, int y, int z, double densityChange);
+
 	// Applies the bp's effect to the grid
 	// The s paramater indicates whether the effect of the bp is being added or subtracted from the grid.  A value of add will
 	// add, while a value of subtract will subtract
 	void adjustGrid(const BlockPoint *bp, const adjustment adj);
 
+	// Adds densityAdjustment to the density of the unit and returns the resulting change in its effective (clamped) density
+	double changeUnitDensity(int x, int y, int z, double densityAdjustment);
+
+	// If the unit at (x, y, z) is full (has a density of at least 1) and stays full after densityAdjustment, adds densityAdjustment
+	// to its density and returns true.  Nothing else on the grid depends on how far past 1 a unit's density is, so this is the
+	// whole change.  A full unit's density past 1 acts as a count of its overflow: only once that runs out does a change need a
+	// cone
+	bool absorbSaturatedAdjustment(int x, int y, int z, double densityAdjustment);
+
+	// Makes the adjustment right away with absorbSaturatedAdjustment() if it can, or else appends it to adjustments for
+	// applyDensityAdjustments().  Adjustments that are absorbed while others to the same unit are waiting do not change the
+	// result, since the unit is full before and after each of them
+	void queueDensityAdjustment(std::vector<DensityAdjustment> &adjustments, int x, int y, int z, double densityAdjustment);
+
+	// Calls changeUnitDensity() and applies the change to the units in the unit's cone
+	void adjustUnitDensity(int x, int y, int z, double densityAdjustment);
+
+	// Moves densityAdjustment of density from one unit to another.  Does the same as adjustUnitDensity() with -densityAdjustment
+	// on the first unit and densityAdjustment on the second, but when the units are neighbors and the clamped changes of the two
+	// cancel out, applies them together with the shift stencil
+	void moveUnitDensity(int fromX, int fromY, int fromZ, int toX, int toY, int toZ, double densityAdjustment);
+
+	// Combines all adjustments to the same unit, changes each unit's density once, then applies each nonzero change to the
+	// cone of its unit.  Sorts adjustments
+	void applyDensityAdjustments(std::vector<DensityAdjustment> &adjustments);
+
+	// Applies the cone of every update, splitting the work between threadCount threads
+	// The grid is divided into tiles along all three axes, each as large as the cone (see tileSize()).  The cones of units in two
+	// tiles that are not next to each other on some axis can never overlap, so the tiles are given one of 8 colors by whether
+	// their position on each axis is even or odd, and all tiles of one color are updated at the same time, one color after
+	// another.  Within a tile, updates are applied in order, so every unit receives its changes in the same order regardless of
+	// the number of threads, including when there is only one
+	// pre: updates are sorted by unit index
+	void applyConeUpdates(const std::vector<ConeUpdate> &updates);
+
 	// Checks that each index is within the range of the grid
 	bool indicesAreInRange(int x, int y, int z) const;
 
@@ -144,7 +750,17 @@ public:
 
 	// All units are assumed to be cubes
 	// XSIZE, YSIZE, and ZSIZE should divide evenly by UNITSIZE
-	BlockPointGrid(double XSIZE, double YSIZE, double ZSIZE, double UNITSIZE, double DETECTIONRANGE, double CONERANGEANGLE, double INTENSITY);
+	// If SPARSE is true, units are only allocated when they are first changed (see sparseStorage), which saves memory on grids
+	// where most units are never blocked
+	BlockPointGrid(double XSIZE, double YSIZE, double ZSIZE, double UNITSIZE, double DETECTIONRANGE, double CONERANGEANGLE, double INTENSITY,
+		bool SPARSE = false);
+
+	bool usesSparseStorage() const { return sparseStorage; }
+
+	// The number of units currently held in memory.  Without sparse storage, this is every unit on the grid
+	std::size_t storedUnitCount() const;
+
+	// The display methods create Maya meshes, so they are defined in BlockPointGrid_display.cpp, which is only part of the plug-in
 
 	void displayGrid() const;
 
@@ -170,13 +786,217 @@ public:
 	// Creates a new BlockPoint and adjusts any affected units.  
 	// The pointer reference is for Segments' pointers to their BlockPoints - they are the only handles to BlockPoints that exist
 	// outside of the BlockPointGrid
-	MStatus addBlockPoint(const Point loc, double bpDensity, BlockPoint *&ptrForSeg);
+	PhotStatus addBlockPoint(const Point loc, double bpDensity, BlockPoint *&ptrForSeg);
+
+	// The same as above, but gives a handle to the new BlockPoint
+	PhotStatus addBlockPoint(const Point loc, double bpDensity, BlockPointHandle &handle);
 
 	// Moves the passed BlockPoint to the new location.  Subtracts its effects from previously affected units and adds its effects to newly affected ones
-	MStatus moveBlockPoint(BlockPoint *bp, const Point newLoc);
+	PhotStatus moveBlockPoint(BlockPoint *bp, const Point newLoc);
+
+	PhotStatus moveBlockPoint(const BlockPointHandle &handle, const Point newLoc);
+
+	// Batch version of addBlockPoint().  Creates a BlockPoint for each entry of locs, with the density at the same position in
+	// bpDensities, then updates the grid once for each unit that gained density, no matter how many BlockPoints it gained.
+	// ptrsForSegs is filled with the new BlockPoints in the order of locs.  Locations outside of the grid get a nullptr, and
+	// cause kFailure to be returned once the rest have been added
+	PhotStatus addBlockPoints(const std::vector<Point> &locs, const std::vector<double> &bpDensities, std::vector<BlockPoint*> &ptrsForSegs);
+
+	// The same as above, but gives handles.  Locations outside of the grid get a handle that refers to nothing
+	PhotStatus addBlockPoints(const std::vector<Point> &locs, const std::vector<double> &bpDensities, std::vector<BlockPointHandle> &handles);
+
+	// Batch version of moveBlockPoint().  Moves each BlockPoint in bpsToMove to the location at the same position in newLocs, then
+	// updates the grid once for each unit whose density changed.  BlockPoints whose new location is outside of the grid are not
+	// moved, and cause kFailure to be returned once the rest have been moved
+	// Only each unit's net change over all of the moves is applied, so BlockPoints leaving a unit while others with the same total
+	// density enter it usually cost nothing (always, with exact accumulation; otherwise a rounding residue can remain).  When
+	// many BlockPoints move by small amounts at once, such as when a branch bends, this is much cheaper than calling
+	// moveBlockPoint() for each
+	PhotStatus moveBlockPoints(const std::vector<BlockPoint*> &bpsToMove, const std::vector<Point> &newLocs);
+
+	// The same as above, but takes handles.  Out of date handles are skipped, and cause kFailure to be returned
+	PhotStatus moveBlockPoints(const std::vector<BlockPointHandle> &handlesToMove, const std::vector<Point> &newLocs);
+
+	// Subtracts the BlockPoint's effects from the grid and frees it.  Pointers to it become invalid and handles to it out of date
+	PhotStatus removeBlockPoint(const BlockPointHandle &handle);
+
+	// Changes the BlockPoint's density, updating the grid with the difference
+	PhotStatus setBlockPointDensity(const BlockPointHandle &handle, double newDensity);
+
+	// Batch version of removeBlockPoint().  Updates the grid once for each unit that lost density.  Out of date handles,
+	// including repeats of a handle already removed, are skipped, and cause kFailure to be returned
+	PhotStatus removeBlockPoints(const std::vector<BlockPointHandle> &handles);
+
+	// Batch version of setBlockPointDensity().  Sets the density of each BlockPoint in handles to the density at the same
+	// position in newDensities, then updates the grid once for each unit whose density changed.  Out of date handles are
+	// skipped, and cause kFailure to be returned
+	PhotStatus setBlockPointDensities(const std::vector<BlockPointHandle> &handles, const std::vector<double> &newDensities);
+
+	// The BlockPoint the handle refers to, or nullptr if it has been removed or the handle is not from this grid
+	const BlockPoint *getBlockPoint(const BlockPointHandle &handle) const;
+
+	// A handle to a BlockPoint held by this grid
+	BlockPointHandle handleOf(const BlockPoint *bp) const { return { bp->slot, bp->generation }; }
+
+	bool isValid(const BlockPointHandle &handle) const { return getBlockPoint(handle) != nullptr; }
+
+	std::size_t blockPointCount() const { return liveBlockPoints; }
+
+	// Rebuilds every unit's light direction and blockage from the densities of the units, using up to threadCount threads
+	// Changes are summed without resizing, so when normalization is not deferred, the result can differ slightly from the order
+	// dependent result of adding BlockPoints one by one.  On dense grids without coarse levels, where it is estimated to be
+	// cheaper, the sums are computed as a 3-D convolution of the units' densities with the cone, using fast Fourier transforms
+	// of the grid padded to powers of two.  Its cost then depends only on the size of the grid, and with exact accumulation,
+	// the result is still exact.  Otherwise, each unit with density has its cone applied once, so the cost depends on the number
+	// of those units times the size of the cone, and the result is the same as adding every BlockPoint in one batch
+	void recomputeGrid();
+
+	double getIntensity() const { return intensity; }
+
+	double getConeRangeAngle() const { return coneRangeAngle; }
+
+	double getDetectionRange() const { return detectionRange; }
+
+	// The setters below update the grid to match the new value, as if every BlockPoint had been added with it
+	// With normalization deferred, setIntensity() only rescales each unit's light, and setConeRangeAngle() rescales each unit's
+	// light and applies the parts of the cone that were added or removed.  Otherwise, they recompute the grid (see recomputeGrid())
+
+	PhotStatus setIntensity(double newIntensity);
+
+	PhotStatus setConeRangeAngle(double newConeRangeAngle);
+
+	// Always recomputes the grid, since every weight in the cone depends on detectionRange
+	PhotStatus setDetectionRange(double newDetectionRange);
+
+	// Sets the number of threads that batch calls, recomputeGrid() and refreshQueryCache() may use.  Values below 1 are treated
+	// as 1.  The threads are started here and kept until the thread count changes again or the grid is destroyed
+	// The result is the same for any thread count: threads share out the tiles of one color at a time, whose updates reach
+	// different units, and each tile's updates are applied in order (see applyConeUpdates())
+	void setThreadCount(int threads);
+
+	int getThreadCount() const { return threadCount; }
+
+	// Chooses whether light directions are resized after every change (the default) or only when they are read.  Deferring
+	// halves the work of applying a cone and makes the result independent of the order in which changes are applied
+	// Can only be changed before any BlockPoints are added
+	PhotStatus setDeferredNormalization(bool defer);
+
+	bool normalizationIsDeferred() const { return deferLightNormalization; }
+
+	// Chooses whether changes are accumulated exactly.  BlockPoint densities are rounded to multiples of 2^-20, and the cone's
+	// weights to multiples of a power of two small enough that no unit's sums can need more than 51 bits at that resolution.
+	// Every product of a density change and a weight, and every sum of them, is then exact, so the grid does not depend on the
+	// order of changes, on the number of threads, or on batching, and a unit whose BlockPoints are all removed returns exactly
+	// to its unblocked state.  Weights change by less than a billionth of the largest unit sum.  Normalization is deferred (see
+	// setDeferredNormalization()), and coarse levels cannot be used
+	// Can only be changed before any BlockPoints are added
+	PhotStatus setExactAccumulation(bool exact);
+
+	bool accumulationIsExact() const { return exactAccumulation; }
+
+	// Splits the cone so that only its near part is applied at full resolution.  The rest is divided between levels coarse
+	// levels, each with half the resolution of the one before, and each taking a shell of the cone twice as far out.  The last
+	// level reaches detectionRange, and the full resolution part reaches detectionRange / 2^levels.  Queries add up all levels
+	// This keeps the cost of a change nearly constant as detectionRange grows, at the price of blurring the far part of the cone
+	// over the coarse units.  Since the levels are summed, normalization is deferred (see setDeferredNormalization())
+	// Can only be changed before any BlockPoints are added.  0 removes the coarse levels
+	PhotStatus setCoarseLevels(int levels);
+
+	int getCoarseLevels() const { return int(coarseLevels.size()); }
+
+	// Chooses whether a BlockPoint moving to one of the 26 neighboring units is applied with a precomputed difference stencil:
+	// the cone at the new unit minus the cone at the old one.  This replaces a pass over the old cone and a pass over the new
+	// one with a single pass over their union, leaving out entries whose weights differ by no more than rounding.  Since the
+	// weights change with the offset, a stencil is close to the union of the two cones, so the saving is at most one cone pass,
+	// and only for moves where neither unit is or becomes full.  A shift whose stencil would cost as much as the two cones has
+	// none, and its moves apply both cones.  Only moveBlockPoint() uses the stencils; moveBlockPoints() already combines changes
+	// per unit.  Since the two cones are summed, normalization is deferred (see setDeferredNormalization()).  The stencils take
+	// about 26 times the memory of the cone
+	// Can be turned on once BlockPoints have been added only if normalization is already deferred
+	PhotStatus setShiftStencils(bool use);
+
+	bool usesShiftStencils() const { return useShiftStencils; }
+
+	// Chooses whether a dense grid stores each unit's blockage and light direction in floats rather than doubles, which cuts the
+	// unit data that changes are applied to from 40 to 24 bytes per unit.  Changes are still computed in doubles, but each
+	// sum is rounded to a float when stored, so sums drift by up to about 1e-7 of their size with each change, and removing
+	// every BlockPoint does not return units exactly to their unblocked state.  Normalization is deferred (see
+	// setDeferredNormalization()).  Cannot be used with exact accumulation, whose sums need doubles, or with sparse storage
+	// Can only be changed before any BlockPoints are added
+	PhotStatus setFloatStorage(bool useFloats);
+
+	bool usesFloatStorage() const { return floatStorage; }
+
+	// Chooses whether the query cache (see refreshQueryCache()) holds full doubles (the default) or packs each unit's results
+	// into 16 bit integers, which cuts the memory of each unit from 72 to 48 bytes and the memory read by each query to a
+	// quarter.  Packed directions are within 1.6e-5 of the full ones on each axis, and blockages within 7.7e-6, clamped to
+	// [0, 1].  The unit data that changes are applied to is not affected; see setFloatStorage() for storing it in less
+	// Changing it marks the whole cache as out of date
+	void setPackedQueryCache(bool packed);
+
+	bool queryCacheIsPacked() const { return packedQueryCache; }
+
+	// Chooses whether queries use the unit containing the meristem (the default), or blend the results of the 8 units whose
+	// centers surround it, so that directions change smoothly as a meristem crosses from one unit to the next
+	void setInterpolatedQueries(bool interpolate) { interpolateQueries = interpolate; }
+
+	bool queriesAreInterpolated() const { return interpolateQueries; }
 
 	// Gives the chosen direction and blockage for a meristem depending on its current direction and location
-	MStatus getDirectionAndBlockage(const Point &meriLoc, CVect &chosenDirection, double &blockage) const;
+	// Units that have not changed since the last refreshQueryCache() are answered from the cache.  Others are computed, but not
+	// cached, so any number of threads may query at once
+	PhotStatus getDirectionAndBlockage(const Point &meriLoc, CVect &chosenDirection, double &blockage) const;
+
+	// Batch version of getDirectionAndBlockage().  Fills chosenDirections and blockages with the results for each entry of
+	// meriLocs, in the same order, splitting large batches between up to threadCount threads.  Locations outside of the grid
+	// get a zero direction and blockage, and cause kFailure to be returned once the rest have been answered
+	// If sortByUnit is true, queries are answered in order of unit, so meristems in the same unit are handled together and the
+	// grid is read in memory order.  Sorting costs more than it saves unless the grid is much larger than the processor's cache
+	PhotStatus getDirectionsAndBlockages(const std::vector<Point> &meriLocs, std::vector<CVect> &chosenDirections,
+		std::vector<double> &blockages, bool sortByUnit = false) const;
+
+	// Recomputes the cached query results of every unit changed since the last refresh, using up to threadCount threads
+	// Call this after updating the grid and before querying, e.g. once per growth step.  With dense storage, the first call
+	// allocates the cache
+	void refreshQueryCache();
+
+	// Event logs are defined in BlockPointGrid_events.cpp, which describes the format
+
+	// Starts appending every change made to the grid's BlockPoints and parameters to a binary log at path, replacing any file
+	// already there.  Only changes that succeed are logged.  Logging continues until stopEventLog() or the grid is destroyed
+	// The settings that decide what a change does are recorded when logging starts, so setDeferredNormalization(),
+	// setExactAccumulation(), setFloatStorage(), setCoarseLevels() and setShiftStencils() fail while logging.  The thread count
+	// can still change, since it does not change any result (see setThreadCount())
+	PhotStatus startEventLog(const std::string &path);
+
+	void stopEventLog();
+
+	bool isLoggingEvents() const { return eventLog != nullptr; }
+
+	// Makes the changes in a log written by startEventLog() to this grid, which must be in the state the logged grid was in
+	// when logging started: a new grid with the same parameters and settings, or one loaded from a snapshot saved then.  Fails,
+	// without making any change, if the grid's size, BlockPoint count, parameters or settings differ from the logged ones
+	// Unless batched is true, each change is made with the same kind of call that made it originally, so the result is identical
+	// With batched true, consecutive changes of the same kind are made with one batch call.  That is faster, and gives an
+	// identical result with exact accumulation (see setExactAccumulation()).  Otherwise the result differs slightly, as it does
+	// whenever changes are made in a different order (see setDeferredNormalization())
+	PhotStatus replayEventLog(const std::string &path, bool batched = false);
+
+	// Snapshots are defined in BlockPointGrid_snapshot.cpp, which describes the format
+
+	// Writes the grid's parameters and settings, the data of its units and coarse levels, and its BlockPoints to a binary file
+	// The query cache is not saved
+	PhotStatus saveSnapshot(const std::string &path) const;
+
+	// Creates grid from a file written by saveSnapshot().  Handles to the saved grid's BlockPoints refer to the same BlockPoints
+	// in the loaded grid, and it continues exactly as the saved grid would have.  The thread count is not saved
+	// Fails without allocating the grid when its header asks for more units or slots than the file holds
+	static PhotStatus loadSnapshot(const std::string &path, std::unique_ptr<BlockPointGrid> &grid);
+
+	// The grid's stats (see GridStats).  All zero unless the core was built with PHOT_GRID_STATS defined
+	GridStats getStats() const;
+
+	void resetStats();
 
 	// For testing purposes
 	// Adds a block point to every unit between and including the indices
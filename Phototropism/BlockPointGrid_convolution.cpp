@@ -0,0 +1,337 @@
+/*
+	BlockPointGrid_convolution.cpp
+
+	Defines convolveGrid(), which rebuilds the light field of a grid for rebuildGrid() with fast Fourier transforms
+
+	Summed without resizing, a unit's light direction is maximumLightVector plus the sum, over every unit with density, of that
+	unit's effective density times the cone's weight at the offset between them, and its blockage is the same sum of the
+	cone's strengths.  The weights only depend on the offset, so each of the four sums over the whole grid is a 3-D convolution
+	of the effective densities with the cone.  A convolution is a product of Fourier transforms, so the cost of rebuilding is
+	that of a few transforms of a grid padded to powers of two, rather than the number of units with density times the size of
+	the cone.  The padding is at least the size of the cone on each axis, so cones that would fall off one side of the grid do
+	not wrap around onto the other
+
+	The transforms are radix-2 and work on complex numbers, so two of the real sums share each transform: lightX and lightY in
+	one, lightZ and blockage in the other.  Every line along each axis is transformed in turn, split between the grid's threads
+
+	With exact accumulation, the sums must come out exactly as applying the cones would give them.  Densities are then whole
+	multiples of 2^-densityQuantumBits, and weights of weightQuantum, so the sums are whole numbers of their product.  Densities
+	are split into two 10 bit parts and weights into two 16 bit parts, and each pair of parts is convolved separately.  Each of
+	those convolutions is small enough that the error of the transforms (Percival's bound, checked before convolving) is below
+	a quarter, so rounding it gives the exact whole number, and the four are combined in 64 bit integers
+
+	Convolving costs a few times the memory of the grid, for the padded transforms
+*/
+
+#include <atomic>
+#include <complex>
+
+#include "BlockPointGrid.h"
+
+typedef std::complex<double> Complex;
+
+// std::complex's operator* checks for infinities, which makes it several times slower
+static Complex multiply(const Complex &a, const Complex &b) {
+
+	return Complex(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+}
+
+// The smallest power of two that is at least n
+static int powerOfTwoAtLeast(int n) {
+
+	int power = 1;
+	while (power < n)
+		power <<= 1;
+
+	return power;
+}
+
+// Transforms the n values, n a power of two, in place.  roots holds e^(-2 pi i k / n) for k from 0 to n / 2 - 1.  The inverse
+// transform is not divided by n
+static void transformLine(Complex *values, int n, const std::vector<Complex> &roots, bool inverse) {
+
+	for (int i = 1, j = 0; i < n; ++i) {
+
+		int bit = n >> 1;
+		for (; j & bit; bit >>= 1)
+			j ^= bit;
+		j ^= bit;
+
+		if (i < j)
+			std::swap(values[i], values[j]);
+	}
+
+	for (int length = 2; length <= n; length <<= 1) {
+
+		int half = length / 2;
+		int step = n / length;
+
+		for (int start = 0; start < n; start += length) {
+
+			for (int k = 0; k < half; ++k) {
+
+				Complex root = inverse ? std::conj(roots[k * step]) : roots[k * step];
+				Complex u = values[start + k];
+				Complex v = multiply(values[start + k + half], root);
+				values[start + k] = u + v;
+				values[start + k + half] = u - v;
+			}
+		}
+	}
+}
+
+static std::vector<Complex> rootsOfUnity(int n) {
+
+	// MM::PI has 15 digits, which is not enough for the error bound of exact accumulation
+	const double pi = std::acos(-1.);
+
+	std::vector<Complex> roots(n / 2);
+	for (int k = 0; k < n / 2; ++k)
+		roots[k] = std::polar(1., -2. * pi * k / n);
+
+	return roots;
+}
+
+static bool isZero(const Complex *values, int n) {
+
+	for (int i = 0; i < n; ++i) {
+
+		if (values[i] != Complex(0., 0.))
+			return false;
+	}
+
+	return true;
+}
+
+void BlockPointGrid::fourierTransform(std::vector<Complex> &values, const int size[3], bool inverse) const {
+
+	std::vector<Complex> roots[3] = { rootsOfUnity(size[0]), rootsOfUnity(size[1]), rootsOfUnity(size[2]) };
+	std::size_t planeSize = std::size_t(size[1]) * size[2];
+
+	// Lines along z are contiguous.  Each thread takes one x index (a plane of lines) at a time
+	{
+		std::atomic<int> nextX(0);
+
+		this->runOnThreads(size[0], [&]() {
+
+			for (int x = nextX++; x < size[0]; x = nextX++) {
+
+				for (int y = 0; y < size[1]; ++y) {
+
+					Complex *line = &values[x * planeSize + std::size_t(y) * size[2]];
+					if (!isZero(line, size[2]))
+						transformLine(line, size[2], roots[2], inverse);
+				}
+			}
+		});
+	}
+
+	// Lines along y and x are gathered into contiguous memory, all z indices of a plane at once, so that reading them reads
+	// the grid in runs of size[2] values
+	for (int axis = 1; axis >= 0; --axis) {
+
+		int length = size[axis];
+		int planes = size[1 - axis];
+		std::size_t stride = axis == 1 ? std::size_t(size[2]) : planeSize;
+		std::size_t planeStride = axis == 1 ? planeSize : std::size_t(size[2]);
+		std::atomic<int> nextPlane(0);
+
+		this->runOnThreads(planes, [&]() {
+
+			std::vector<Complex> lines(std::size_t(length) * size[2]);
+
+			for (int p = nextPlane++; p < planes; p = nextPlane++) {
+
+				Complex *base = &values[p * planeStride];
+
+				for (int k = 0; k < length; ++k) {
+					for (int z = 0; z < size[2]; ++z)
+						lines[std::size_t(z) * length + k] = base[k * stride + z];
+				}
+
+				for (int z = 0; z < size[2]; ++z) {
+
+					Complex *line = &lines[std::size_t(z) * length];
+					if (!isZero(line, length))
+						transformLine(line, length, roots[axis], inverse);
+				}
+
+				for (int k = 0; k < length; ++k) {
+					for (int z = 0; z < size[2]; ++z)
+						base[k * stride + z] = lines[std::size_t(z) * length + k];
+				}
+			}
+		});
+	}
+}
+
+bool BlockPointGrid::convolveGrid(const std::vector<ConeUpdate> &occupied) {
+
+	// Sparse grids would have every row allocated by the result, and coarse levels are not part of the cone
+	if (sparseStorage || !coarseLevels.empty() || occupied.empty())
+		return false;
+
+	int size[3] = { powerOfTwoAtLeast(xElements + cone.maxX - cone.minX), powerOfTwoAtLeast(yElements + cone.maxY - cone.minY),
+		powerOfTwoAtLeast(zElements + cone.maxZ - cone.minZ) };
+	std::size_t total = std::size_t(size[0]) * size[1] * size[2];
+	double passes = std::log2(double(size[0])) + std::log2(double(size[1])) + std::log2(double(size[2]));
+
+	// The parts densities and weights are split into, and the number of bits in each but the last (see the top of this file)
+	int densityParts = exactAccumulation ? 2 : 1;
+	int weightParts = exactAccumulation ? 2 : 1;
+	const int densityPartBits = 10;
+	const int weightPartBits = 16;
+
+	// Applying the cones costs about 1.6 ns per entry, and a transform about 1.7 ns per value for each power of two in its size,
+	// as measured by gridBenchmark's canopy cases with 1 thread.  Both share threads alike
+	int transforms = densityParts + weightParts * 2 + densityParts * weightParts * 2;
+	double applyingNanoseconds = 1.6 * double(occupied.size()) * cone.strength.size();
+	double convolvingNanoseconds = 1.7 * transforms * double(total) * passes;
+	if (convolvingNanoseconds >= applyingNanoseconds)
+		return false;
+
+	auto fftIndex = [&](int x, int y, int z) {
+
+		// Offsets below zero wrap around to the end
+		x = (x + size[0]) % size[0];
+		y = (y + size[1]) % size[1];
+		z = (z + size[2]) % size[2];
+		return (std::size_t(x) * size[1] + y) * size[2] + z;
+	};
+
+	// Splits value, a whole number, into the part'th of parts, with the given number of bits in each but the last
+	auto split = [](double value, int part, int parts, int bits) {
+
+		if (parts == 1)
+			return value;
+
+		double low = value - std::floor(std::ldexp(value, -bits)) * std::ldexp(1., bits);
+		return part == 0 ? low : std::ldexp(value - low, -bits);
+	};
+
+	// Values are scaled to whole numbers of their quanta with exact accumulation
+	double densityScale = exactAccumulation ? std::ldexp(1., densityQuantumBits) : 1.;
+	double weightScale = exactAccumulation ? 1. / weightQuantum : 1.;
+
+	std::vector< std::vector<Complex> > densitySpectra(densityParts);
+	std::vector<double> densityNorms(densityParts, 0.);
+	for (int part = 0; part < densityParts; ++part) {
+
+		densitySpectra[part].assign(total, Complex(0., 0.));
+		for (const auto &update : occupied) {
+
+			double value = split(update.densityChange * densityScale, part, densityParts, densityPartBits);
+			densitySpectra[part][fftIndex(update.x, update.y, update.z)] = value;
+			densityNorms[part] += value * value;
+		}
+
+		densityNorms[part] = std::sqrt(densityNorms[part]);
+	}
+
+	// The weights of lightX and lightY are the real and imaginary parts of one kernel, and those of lightZ and blockage of the other
+	const std::vector<double> *kernelWeights[2][2] = { { &cone.lightX, &cone.lightY }, { &cone.lightZ, &cone.strength } };
+
+	std::vector<Complex> kernels[2][2];
+	for (int part = 0; part < weightParts; ++part) {
+
+		for (int k = 0; k < 2; ++k) {
+
+			std::vector<Complex> &kernel = kernels[part][k];
+			kernel.assign(total, Complex(0., 0.));
+			double norm = 0.;
+
+			for (const auto &run : cone.runs) {
+
+				for (int n = 0; n < run.length; ++n) {
+
+					int entry = run.firstEntry + n;
+					Complex weight(split((*kernelWeights[k][0])[entry] * weightScale, part, weightParts, weightPartBits),
+						split((*kernelWeights[k][1])[entry] * weightScale, part, weightParts, weightPartBits));
+					kernel[fftIndex(run.x, run.y, run.zStart + n)] = weight;
+					norm += std::norm(weight);
+				}
+			}
+
+			// The error of a convolution of whole numbers computed with n passes is below |a| |b| (10 n + 10) 2^-53.  Rounding
+			// only gives the exact result if that is below a half, so a quarter leaves a margin
+			for (double densityNorm : densityNorms) {
+
+				if (exactAccumulation && densityNorm * std::sqrt(norm) * (10. * passes + 10.) * std::ldexp(1., -53) >= .25)
+					return false;
+			}
+		}
+	}
+
+	for (auto &spectrum : densitySpectra)
+		this->fourierTransform(spectrum, size, false);
+
+	// With exact accumulation, the four sums are added up here in whole numbers of the product of the quanta
+	std::vector<std::int64_t> exactSums[4];
+	if (exactAccumulation) {
+
+		for (auto &sums : exactSums)
+			sums.assign(density.size(), 0);
+	}
+
+	double * const results[4] = { lightX.data(), lightY.data(), lightZ.data(), blockage.data() };
+	float * const floatResults[4] = { floatLightX.data(), floatLightY.data(), floatLightZ.data(), floatBlockage.data() };
+	const double starts[4] = { maximumLightVector.x, maximumLightVector.y, maximumLightVector.z, 0. };
+
+	std::vector<Complex> product(total);
+	for (int weightPart = 0; weightPart < weightParts; ++weightPart) {
+
+		for (int k = 0; k < 2; ++k) {
+
+			std::vector<Complex> &kernel = kernels[weightPart][k];
+			this->fourierTransform(kernel, size, false);
+
+			for (int densityPart = 0; densityPart < densityParts; ++densityPart) {
+
+				const std::vector<Complex> &spectrum = densitySpectra[densityPart];
+				for (std::size_t i = 0; i < total; ++i)
+					product[i] = multiply(spectrum[i], kernel[i]);
+
+				this->fourierTransform(product, size, true);
+
+				int shift = densityPart * densityPartBits + weightPart * weightPartBits;
+				for (int x = 0; x < xElements; ++x) {
+					for (int y = 0; y < yElements; ++y) {
+
+						const Complex *row = &product[fftIndex(x, y, 0)];
+						std::size_t unit = unitIndex(x, y, 0);
+
+						for (int z = 0; z < zElements; ++z) {
+
+							double sums[2] = { row[z].real() / total, row[z].imag() / total };
+
+							for (int c = 0; c < 2; ++c) {
+
+								if (exactAccumulation)
+									exactSums[k * 2 + c][unit + z] += std::int64_t(std::llround(sums[c])) * (std::int64_t(1) << shift);
+								else if (floatStorage)
+									floatResults[k * 2 + c][unit + z] = float(starts[k * 2 + c] + sums[c]);
+								else
+									results[k * 2 + c][unit + z] = starts[k * 2 + c] + sums[c];
+							}
+						}
+					}
+				}
+			}
+
+			std::vector<Complex>().swap(kernel);
+		}
+	}
+
+	// Every sum is below 2^51 quanta (see quantizeWeights()), so converting it and adding it to the start is exact
+	if (exactAccumulation) {
+
+		double quantum = weightQuantum / densityScale;
+		for (int c = 0; c < 4; ++c) {
+
+			for (std::size_t i = 0; i < exactSums[c].size(); ++i)
+				results[c][i] = starts[c] + double(exactSums[c][i]) * quantum;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,164 @@
+/*
+	BlockPointGrid_display.cpp
+
+	Defines the display methods of BlockPointGrid, which visualize the grid with Maya meshes
+	These are only built into the plug-in.  The rest of BlockPointGrid does not depend on Maya
+*/
+
+#include "BlockPointGrid.h"
+#include "MeshMaker.h"
+
+void BlockPointGrid::displayGrid() const {
+
+	for (int xI = 0; xI < xElements; ++xI) {
+
+		for (int yI = 0; yI < yElements; ++yI) {
+
+			for (int zI = 0; zI < zElements; ++zI) {
+
+				std::string unitName = "[" + std::to_string(xI) + "][" + std::to_string(yI) + "][" + std::to_string(zI) + "]"; +
+					"_Density: " + std::to_string(unitDensity(xI, yI, zI));
+
+				//this->displayUnitLightDirection(xI, yI, zI);
+				this->displayAffectedUnitLightDirection(xI, yI, zI);
+				//this->displayUnitBlockage(xI, yI, zI);
+				//this->displayUnitDensity(xI, yI, zI);
+
+				//makeCube(unitCenter(xI, yI, zI), unitSize, unitName);
+			}
+		}
+	}
+}
+
+void BlockPointGrid::displayGridBorder() const {
+
+	// assumes cubic grid
+	makeCube(Point(0., (yElements * unitSize) / 2., 0.), (xElements * unitSize), "gridBorder"); 
+}
+
+void BlockPointGrid::displayUnitsAffectedByUnit(int uX, int uY, int uZ) const {
+
+	for (auto indexVect : indexVectorsToUnitsInCone) {
+
+		int X = uX + indexVect.x;
+		int Y = uY + indexVect.y;
+		int Z = uZ + indexVect.z;
+
+		if (this->indicesAreInRange(X, Y, Z)) {
+
+			makeCube(unitCenter(X, Y, Z), unitSize, "unit");
+		}
+	}
+}
+
+void BlockPointGrid::displayUnitsAffectedByBP(const BlockPoint *bp) const {
+
+	std::size_t xInd = (bp->loc.x + halfGridXSize) / unitSize;
+	std::size_t yInd = bp->loc.y / unitSize;
+	std::size_t zInd = (bp->loc.z + halfGridZSize) / unitSize;
+
+	displayUnitDensity(xInd, yInd, zInd);
+
+	for (auto indexVect : indexVectorsToUnitsInCone) {
+
+		int X = xInd + indexVect.x;
+		int Y = yInd + indexVect.y;
+		int Z = zInd + indexVect.z;
+
+		if (this->indicesAreInRange(X, Y, Z)) {
+
+			displayUnitBlockage(X, Y, Z);
+			//displayUnitDensity(X, Y, Z);
+			displayUnitLightDirection(X, Y, Z);
+		}
+	}
+}
+
+void BlockPointGrid::displayUnitLightDirection(int uX, int uY, int uZ) const {
+
+	// make it so that the arrow's length represents the magnitude of the lightDirection vector, but scaled down so that
+	// the maximum length is equal to unitSize
+	Point lightDirection = unitLightDirection(uX, uY, uZ);
+	double arrowLength = unitSize * (lightDirection.getMag() / maximumLightVector.getMag());
+
+
+	makeArrow(unitCenter(uX, uY, uZ) + Point(0., -unitSize*.5, 0.), CVect(lightDirection).resized(arrowLength),
+		"lightDirectionArrow", .01);
+
+}
+
+void BlockPointGrid::displayAffectedUnitLightDirection(int uX, int uY, int uZ) const {
+
+	//only makeArrow() if the unit has some blockage
+	double percentBlocked = unitBlockage(uX, uY, uZ) / maximumBlockage;
+	if (percentBlocked > 0.) {
+
+		double arrowLength = unitSize * (1. - percentBlocked);
+		//double arrowLength = unitSize * (unitLightDirection(uX, uY, uZ).getMag() / maximumLightVector.getMag());
+		//photLog() << "arrowLength = " << arrowLength << ", unitSize = " << unitSize << ", percentBlocked = " << percentBlocked << "\n";
+		// size the arrow so that it represents the light strength of the unit 
+		//arrowLength = arrowLength * (1. - blockage[unitIndex(uX, uY, uZ)]);
+
+		makeArrow(unitCenter(uX, uY, uZ) + Point(0., -unitSize*.5, 0.), CVect(unitLightDirection(uX, uY, uZ)).resized(arrowLength),
+			"lightDirectionArrow", .01);
+	}
+}
+
+void BlockPointGrid::displayUnitDensity(int uX, int uY, int uZ) const {
+
+	double d = unitDensity(uX, uY, uZ);
+
+	if (d == 0.)
+		return;
+
+	// a unit with maximum density will show an arrow the same size as itself
+	double arrowLength = unitSize * std::min(d, 1.);
+	Point arrowStart = unitCenter(uX, uY, uZ) + Point(-unitSize*.25, -unitSize*.5, 0.);
+	makeArrow(arrowStart, CVect(0., arrowLength, 0., arrowLength), "densityArrow", .01);
+
+}
+
+void BlockPointGrid::displayUnitBlockage(int uX, int uY, int uZ) const {
+
+	double b = unitBlockage(uX, uY, uZ);
+
+	if (b == 0.)
+		return;
+
+	// a unit with maximum blockage will show an arrow the same size as itself
+	double arrowLength = unitSize * (b / maximumBlockage);
+	Point arrowStart = unitCenter(uX, uY, uZ) + Point(unitSize*.25, -unitSize*.5, 0.);
+	makeArrow(arrowStart, CVect(0., arrowLength, 0., arrowLength), "blockageArrow", .01);
+}
+
+void BlockPointGrid::displayBlockPoints() const {
+
+	for (std::uint32_t slot = 0; slot < blockPointSlots; ++slot) {
+
+		const BlockPoint &bp = blockPointInSlot(slot);
+		if (!bp.live)
+			continue;
+
+		int density = bp.density * 1000.;
+		std::string name = "Density--0." + std::to_string(density);
+		makeSphere(bp.loc, .05, name);
+	}
+}
+
+void BlockPointGrid::displayAll() const {
+
+	this->displayBlockPoints();
+
+	for (int xI = 0; xI < xElements; ++xI) {
+
+		for (int yI = 0; yI < yElements; ++yI) {
+
+			for (int zI = 0; zI < zElements; ++zI) {
+
+				displayUnitLightDirection(xI, yI, zI);
+				displayUnitBlockage(xI, yI, zI);
+				displayUnitDensity(xI, yI, zI);
+			}
+		}
+	}
+}
@@ -0,0 +1,320 @@
+/*
+	BlockPointGrid_events.cpp
+
+	Defines the event log, which records every change made to a BlockPointGrid, and replayEventLog(), which makes the changes
+	in a log again
+
+	A log holds, with every value in the byte order and sizes of the machine that wrote it:
+		header:  the 8 characters "PHOTEVNT", the uint32 format version, the uint32 0x01020304, which shows the byte order, then
+		         the state of the grid when logging started: int32 xElements, yElements and zElements, uint32 number of
+		         BlockPoint slots, uint64 number of BlockPoints, double unitSize, detectionRange, coneRangeAngle and intensity,
+		         uint8 deferLightNormalization, exactAccumulation, floatStorage and useShiftStencils, and int32 number of
+		         coarse levels.  These are everything that decides what a change does to the grid, and they cannot be changed
+		         while the log is written
+		records: one after another until the end of the file.  Each is a uint8 GridEvent, a uint32 number of entries, and the
+		         entries, which depend on the kind of record:
+		             kAdd, kAddBatch:                handle, double loc.x, loc.y, loc.z and density
+		             kMove, kMoveBatch:              handle, double newLoc.x, newLoc.y and newLoc.z
+		             kRemove, kRemoveBatch:          handle
+		             kSetDensity, kSetDensityBatch:  handle, double density
+		             kSetIntensity, kSetConeRangeAngle, kSetDetectionRange:  one entry, the double new value
+		             kRecompute:                     no entries
+		         A handle is its uint32 slot followed by its uint32 generation.  Densities are as the BlockPoint holds them
+		         (see storedDensity()), and the handles of added BlockPoints are the ones they were given
+
+	The handles in a log stay meaningful when it is replayed because the grid gives out slots and generations in the same order
+	when the same changes are made to it in the same state
+*/
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "BlockPointGrid.h"
+
+static const char eventLogMagic[8] = { 'P', 'H', 'O', 'T', 'E', 'V', 'N', 'T' };
+
+// Increase when the format changes
+static const std::uint32_t eventLogVersion = 2;
+
+static const std::uint32_t eventLogByteOrder = 0x01020304;
+
+template <typename T>
+static void writeValue(std::ostream &out, const T &value) {
+
+	out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Reads the log held in memory, from pos onwards
+class EventLogReader {
+
+	const std::vector<char> &bytes;
+	std::size_t pos = 0;
+
+public:
+
+	EventLogReader(const std::vector<char> &BYTES) : bytes(BYTES) {}
+
+	bool atEnd() const { return pos == bytes.size(); }
+
+	template <typename T>
+	bool read(T &value) {
+
+		if (bytes.size() - pos < sizeof(T))
+			return false;
+
+		std::memcpy(&value, &bytes[pos], sizeof(T));
+		pos += sizeof(T);
+		return true;
+	}
+
+	bool read(BlockPointHandle &handle) { return read(handle.slot) && read(handle.generation); }
+
+	bool read(Point &p) { return read(p.x) && read(p.y) && read(p.z); }
+};
+
+void BlockPointGrid::logEventStart(GridEvent event, std::uint32_t count) {
+
+	writeValue(*eventLog, std::uint8_t(event));
+	writeValue(*eventLog, count);
+}
+
+void BlockPointGrid::logHandle(const BlockPointHandle &handle) {
+
+	writeValue(*eventLog, handle.slot);
+	writeValue(*eventLog, handle.generation);
+}
+
+void BlockPointGrid::logValue(double value) {
+
+	writeValue(*eventLog, value);
+}
+
+PhotStatus BlockPointGrid::startEventLog(const std::string &path) {
+
+	std::unique_ptr<std::ofstream> log(new std::ofstream(path, std::ios::binary | std::ios::trunc));
+	if (!*log) {
+
+		photLog() << "Error. Could not open " << path << " for the event log.\nAborting\n";
+		return PhotStatus::kFailure;
+	}
+
+	log->write(eventLogMagic, sizeof(eventLogMagic));
+	writeValue(*log, eventLogVersion);
+	writeValue(*log, eventLogByteOrder);
+	writeValue(*log, std::int32_t(xElements));
+	writeValue(*log, std::int32_t(yElements));
+	writeValue(*log, std::int32_t(zElements));
+	writeValue(*log, blockPointSlots);
+	writeValue(*log, std::uint64_t(liveBlockPoints));
+	writeValue(*log, unitSize);
+	writeValue(*log, detectionRange);
+	writeValue(*log, coneRangeAngle);
+	writeValue(*log, intensity);
+	writeValue(*log, std::uint8_t(deferLightNormalization));
+	writeValue(*log, std::uint8_t(exactAccumulation));
+	writeValue(*log, std::uint8_t(floatStorage));
+	writeValue(*log, std::uint8_t(useShiftStencils));
+	writeValue(*log, std::int32_t(coarseLevels.size()));
+
+	eventLog = std::move(log);
+
+	return PhotStatus::kSuccess;
+}
+
+void BlockPointGrid::stopEventLog() {
+
+	eventLog.reset();
+}
+
+PhotStatus BlockPointGrid::replayEventLog(const std::string &path, bool batched) {
+
+	std::vector<char> bytes;
+	{
+		std::ifstream in(path, std::ios::binary);
+		if (!in) {
+
+			photLog() << "Error. Could not open " << path << " to replay it.\nAborting\n";
+			return PhotStatus::kFailure;
+		}
+
+		bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+
+	EventLogReader reader(bytes);
+	std::size_t record = 0;
+
+	auto fail = [&](const char *problem) {
+
+		photLog() << "Error. " << path << " " << problem << " at record " << record << ".\nAborting\n";
+		return PhotStatus::kFailure;
+	};
+
+	char magic[8];
+	std::uint32_t version, byteOrder, slots;
+	std::int32_t xE, yE, zE, levels;
+	std::uint64_t live;
+	double size, range, angle, strength;
+	std::uint8_t deferred, exact, floats, stencils;
+	for (char &c : magic) {
+
+		if (!reader.read(c))
+			return fail("is not an event log");
+	}
+
+	if (std::memcmp(magic, eventLogMagic, sizeof(magic)) != 0 || !reader.read(version) || !reader.read(byteOrder))
+		return fail("is not an event log");
+
+	if (version != eventLogVersion)
+		return fail("was written in a different event log version");
+
+	if (byteOrder != eventLogByteOrder)
+		return fail("was written on a machine with a different byte order");
+
+	if (!reader.read(xE) || !reader.read(yE) || !reader.read(zE) || !reader.read(slots) || !reader.read(live) ||
+		!reader.read(size) || !reader.read(range) || !reader.read(angle) || !reader.read(strength) || !reader.read(deferred) ||
+		!reader.read(exact) || !reader.read(floats) || !reader.read(stencils) || !reader.read(levels))
+		return fail("is truncated");
+
+	if (xE != xElements || yE != yElements || zE != zElements || slots != blockPointSlots || live != liveBlockPoints ||
+		size != unitSize || range != detectionRange || angle != coneRangeAngle || strength != intensity ||
+		(deferred != 0) != deferLightNormalization || (exact != 0) != exactAccumulation || (floats != 0) != floatStorage ||
+		(stencils != 0) != useShiftStencils || levels != int(coarseLevels.size()))
+		return fail("was started on a grid in a different state");
+
+	// Changes waiting to be made with one batch call.  pendingKind is the batch kind of record they came from
+	GridEvent pendingKind = GridEvent::kAddBatch;
+	std::vector<BlockPointHandle> pendingHandles;
+	std::vector<Point> pendingLocs;
+	std::vector<double> pendingDensities;
+
+	auto flush = [&]() {
+
+		PhotStatus status = PhotStatus::kSuccess;
+
+		switch (pendingKind) {
+
+		case GridEvent::kAddBatch: {
+
+			std::vector<BlockPointHandle> handles;
+			status = this->addBlockPoints(pendingLocs, pendingDensities, handles);
+			if (handles != pendingHandles)
+				status = PhotStatus::kFailure;
+			break;
+		}
+		case GridEvent::kMoveBatch:
+			status = this->moveBlockPoints(pendingHandles, pendingLocs);
+			break;
+		case GridEvent::kRemoveBatch:
+			status = this->removeBlockPoints(pendingHandles);
+			break;
+		case GridEvent::kSetDensityBatch:
+			status = this->setBlockPointDensities(pendingHandles, pendingDensities);
+			break;
+		default:
+			break;
+		}
+
+		pendingHandles.clear();
+		pendingLocs.clear();
+		pendingDensities.clear();
+
+		return status;
+	};
+
+	for (; !reader.atEnd(); ++record) {
+
+		std::uint8_t kind;
+		std::uint32_t count;
+		if (!reader.read(kind) || !reader.read(count))
+			return fail("is truncated");
+
+		GridEvent event = GridEvent(kind);
+		if (event > GridEvent::kRecompute)
+			return fail("has an unknown kind of record");
+
+		// Each single kind is directly followed by its batch kind
+		bool single = event == GridEvent::kAdd || event == GridEvent::kMove || event == GridEvent::kRemove ||
+			event == GridEvent::kSetDensity;
+		bool blockPointChange = event < GridEvent::kSetIntensity;
+		GridEvent batchKind = single ? GridEvent(kind + 1) : event;
+
+		if (!pendingHandles.empty() && (!batched || pendingKind != batchKind) && flush() != PhotStatus::kSuccess)
+			return fail("does not match the grid");
+
+		if (!blockPointChange) {
+
+			double value = 0.;
+			if (count > 0 && !reader.read(value))
+				return fail("is truncated");
+
+			PhotStatus status = PhotStatus::kSuccess;
+			if (event == GridEvent::kSetIntensity)
+				status = this->setIntensity(value);
+			else if (event == GridEvent::kSetConeRangeAngle)
+				status = this->setConeRangeAngle(value);
+			else if (event == GridEvent::kSetDetectionRange)
+				status = this->setDetectionRange(value);
+			else
+				this->recomputeGrid();
+
+			if (status != PhotStatus::kSuccess)
+				return fail("does not match the grid");
+
+			continue;
+		}
+
+		pendingKind = batchKind;
+		for (std::uint32_t i = 0; i < count; ++i) {
+
+			BlockPointHandle handle;
+			Point loc;
+			double density = 0.;
+			bool complete = reader.read(handle);
+
+			if (batchKind == GridEvent::kAddBatch || batchKind == GridEvent::kMoveBatch)
+				complete = complete && reader.read(loc);
+
+			if (batchKind == GridEvent::kAddBatch || batchKind == GridEvent::kSetDensityBatch)
+				complete = complete && reader.read(density);
+
+			if (!complete)
+				return fail("is truncated");
+
+			pendingHandles.push_back(handle);
+			pendingLocs.push_back(loc);
+			pendingDensities.push_back(density);
+		}
+
+		// A single change is made with the single call, so that the result matches the logged grid exactly
+		if (single && !batched) {
+
+			PhotStatus status = PhotStatus::kFailure;
+			if (count == 1) {
+
+				BlockPointHandle handle;
+				if (event == GridEvent::kAdd)
+					status = this->addBlockPoint(pendingLocs[0], pendingDensities[0], handle) == PhotStatus::kSuccess &&
+						handle == pendingHandles[0] ? PhotStatus::kSuccess : PhotStatus::kFailure;
+				else if (event == GridEvent::kMove)
+					status = this->moveBlockPoint(pendingHandles[0], pendingLocs[0]);
+				else if (event == GridEvent::kRemove)
+					status = this->removeBlockPoint(pendingHandles[0]);
+				else
+					status = this->setBlockPointDensity(pendingHandles[0], pendingDensities[0]);
+			}
+
+			pendingHandles.clear();
+			pendingLocs.clear();
+			pendingDensities.clear();
+
+			if (status != PhotStatus::kSuccess)
+				return fail("does not match the grid");
+		}
+	}
+
+	if (!pendingHandles.empty() && flush() != PhotStatus::kSuccess)
+		return fail("does not match the grid");
+
+	return PhotStatus::kSuccess;
+}
@@ -1,13 +1,12 @@
-#include <maya/MStreamUtils.h>
-
 #include "BranchMesh.h"
+#include "PhotLog.h"
 #include "Segment.h"
 #include "PhotMath.h"
 #include "Operators.h"
 
 BranchMesh::BranchMesh(Segment *firstSeg, const int currentOrderSides) {
 
-	//MStreamUtils::stdOutStream() << "ENTER FUNCTION - BranchMesh::BranchMesh() " << "\n";
+	//photLog() << "ENTER FUNCTION - BranchMesh::BranchMesh() " << "\n";
 
 	sides = currentOrderSides;
 
@@ -50,7 +49,7 @@ BranchMesh::BranchMesh(Segment *firstSeg, const int currentOrderSides) {
 
 void BranchMesh::go(Segment *seg, const std::vector<double> &preadjusts, std::queue<Segment*> &firstSegsOfBMeshes) {
 
-	//MStreamUtils::stdOutStream() << "ENTER FUNCTION - BranchMesh::go()" << "\n";
+	//photLog() << "ENTER FUNCTION - BranchMesh::go()" << "\n";
 
 	// Check for the beginnings of any new branch meshes
 	std::vector<Segment*> potentialFirstSegs = seg->getConnectedUpperSegs();
@@ -66,11 +65,11 @@ void BranchMesh::go(Segment *seg, const std::vector<double> &preadjusts, std::qu
 	if (!nextSegOnPath) {
 
 		// This should mean this is the last segment for this mesh
-		//MStreamUtils::stdOutStream() << "last seg..." << "\n\n";
+		//photLog() << "last seg..." << "\n\n";
 
 		this->completePath(seg, preadjusts);
 
-		//MStreamUtils::stdOutStream() << "path completed.  verts: " << verts.size() << ", faceConnects: " << faceConnects.size() <<
+		//photLog() << "path completed.  verts: " << verts.size() << ", faceConnects: " << faceConnects.size() <<
 		//	", faceCounts: " << faceCounts.size() << "\n\n";
 
 		return;
@@ -98,26 +97,26 @@ void BranchMesh::go(Segment *seg, const std::vector<double> &preadjusts, std::qu
 
 Segment * BranchMesh::findNextSegOnPath(Segment *currentSeg) {
 
-	//MStreamUtils::stdOutStream() << "ENTER FUNCTION - BranchMesh::findNextSegOnPath()" << "\n";
+	//photLog() << "ENTER FUNCTION - BranchMesh::findNextSegOnPath()" << "\n";
 
 	for (auto segAbove : currentSeg->getSegsAbove()) {
 
-		//MStreamUtils::stdOutStream() << "checking meri of seg in segsAbove" << "\n";
+		//photLog() << "checking meri of seg in segsAbove" << "\n";
 
 		if (segAbove->getMeri() == currentSeg->getMeri()) {
-			//MStreamUtils::stdOutStream() << "found next seg on path" << "\n";
-			//MStreamUtils::stdOutStream() << "EXIT FUNCTION - BranchMesh::findNextSegOnPath()" << "\n";
+			//photLog() << "found next seg on path" << "\n";
+			//photLog() << "EXIT FUNCTION - BranchMesh::findNextSegOnPath()" << "\n";
 			return segAbove;
 		}
 	}
 
-	//MStreamUtils::stdOutStream() << "EXIT FUNCTION - BranchMesh::findNextSegOnPath()" << "\n";
+	//photLog() << "EXIT FUNCTION - BranchMesh::findNextSegOnPath()" << "\n";
 	return nullptr;
 }
 
 void BranchMesh::completePath(Segment *lastSeg, const std::vector<double> &preadjusts) {
 
-	//MStreamUtils::stdOutStream() << "ENTER FUNCTION - BranchMesh::completePath() " << "\n";
+	//photLog() << "ENTER FUNCTION - BranchMesh::completePath() " << "\n";
 
 	std::size_t lowerRingFirstVert = verts.size() - sides;
 	for (int i = 0; i < sides; ++i)
@@ -135,17 +134,17 @@ void BranchMesh::completePath(Segment *lastSeg, const std::vector<double> &pread
 
 	this->addCapFaceConnectsAndCounts();
 
-	//MStreamUtils::stdOutStream() << "EXIT FUNCTION - BranchMesh::completePath()" << "\n";
+	//photLog() << "EXIT FUNCTION - BranchMesh::completePath()" << "\n";
 }
 
 double BranchMesh::findDividerIfAny(const double currentSegRadius, Segment *nextSegOnPath) const {
 
-	//MStreamUtils::stdOutStream() << "ENTER FUNCTION - BranchMesh::findDividerIfAny()" << "\n";
+	//photLog() << "ENTER FUNCTION - BranchMesh::findDividerIfAny()" << "\n";
 
 	double radiusMinPercentDiff = 1.15;
 	double radiusOfSegAbove = nextSegOnPath->getRadius();
 
-	//MStreamUtils::stdOutStream() << "this radius: " << currentSegRadius << ", last radius: " << radiusOfSegAbove << "\n";
+	//photLog() << "this radius: " << currentSegRadius << ", last radius: " << radiusOfSegAbove << "\n";
 
 	if (currentSegRadius > radiusOfSegAbove * radiusMinPercentDiff) {
 
@@ -160,9 +159,9 @@ double BranchMesh::findDividerIfAny(const double currentSegRadius, Segment *next
 		}
 
 		if (largestRadius == 0. || largestRadius >= nextSegOnPath->getLength())
-			MStreamUtils::stdOutStream() << "WARNING: creating divider with funny width: " << largestRadius << "\n";
+			photLog() << "WARNING: creating divider with funny width: " << largestRadius << "\n";
 
-		//MStreamUtils::stdOutStream() << "largestRadius: " << largestRadius << "\n";
+		//photLog() << "largestRadius: " << largestRadius << "\n";
 
 		return largestRadius;
 	}
@@ -198,7 +197,7 @@ std::vector<Point> BranchMesh::makeRingToAddTo(const double radiusDiff, const Po
 std::vector<double> BranchMesh::createNextRing(Segment *currentSeg, Segment *nextSeg, const std::vector<double> &preadjusts,
 	const double halfDividerWidth, const std::vector<Point> &ringToAddTo) {
 
-	//MStreamUtils::stdOutStream() << "ENTER FUNCTION - BranchMesh::createNextRing()" << "\n";
+	//photLog() << "ENTER FUNCTION - BranchMesh::createNextRing()" << "\n";
 
 	// We can create the next ring/segment on a mesh by simply adding the segment's vector to each of the vertices on the
 	// previous ring, each sum being the location of a new vertex on the next ring.  However, unless the angle between the two
@@ -209,7 +208,7 @@ std::vector<double> BranchMesh::createNextRing(Segment *currentSeg, Segment *nex
 	std::vector<double> newPreadjusts;
 	const double angBetweenSegments = findAngBetween(currentSeg->getVect(), nextSeg->getVect());
 
-	//MStreamUtils::stdOutStream() << "angBetweenSegments: " << angBetweenSegments << "\n";
+	//photLog() << "angBetweenSegments: " << angBetweenSegments << "\n";
 
 	if (angBetweenSegments > .0001 || angBetweenSegments < -.0001) {
 
@@ -234,7 +233,7 @@ std::vector<double> BranchMesh::createNextRing(Segment *currentSeg, Segment *nex
 		double maxAdjust = bottomTriangleVSide - topTriangleVSide;
 
 		if (std::fabs(maxAdjust) >= currentSeg->getVect().getMag())
-			MStreamUtils::stdOutStream() << "WARNING: angle between segments is too big.  Your mesh probably looks funny. " << "\n";
+			photLog() << "WARNING: angle between segments is too big.  Your mesh probably looks funny. " << "\n";
 
 		for (int s = 0; s < sides; ++s) {
 
@@ -267,14 +266,14 @@ std::vector<double> BranchMesh::createNextRing(Segment *currentSeg, Segment *nex
 		}
 	}
 
-	//MStreamUtils::stdOutStream() << "EXIT FUNCTION - BranchMesh::createNextRing()" << "\n";
+	//photLog() << "EXIT FUNCTION - BranchMesh::createNextRing()" << "\n";
 
 	return newPreadjusts;
 }
 
 void BranchMesh::createDividerRing(const double halfDividerWidth, Segment *currentSeg, Segment *nextSeg, const std::vector<double> &preadjusts) {
 
-	//MStreamUtils::stdOutStream() << "ENTER FUNCTION - BranchMesh::createDividerRing()" << "\n";
+	//photLog() << "ENTER FUNCTION - BranchMesh::createDividerRing()" << "\n";
 
 	int topRingFirstVert = verts.size() - sides;
 	for (int s = 0; s < sides; ++s) {
@@ -294,7 +293,7 @@ void BranchMesh::createDividerRing(const double halfDividerWidth, Segment *curre
 		verts[topRingFirstVert + s] -= currentSeg->getVect().resized(halfDividerWidth);
 	}
 
-	//MStreamUtils::stdOutStream() << "EXIT FUNCTION - BranchMesh::createDividerRing()" << "\n";
+	//photLog() << "EXIT FUNCTION - BranchMesh::createDividerRing()" << "\n";
 }
 
 // Adds faceConnects for the faces between the last and second-to-last rings of verts created 
@@ -459,44 +458,44 @@ void BranchMesh::calculateUVs()
 
 void BranchMesh::reportInMaya() {
 
-	MStreamUtils::stdOutStream() << "\n" << verts.size() << " Verts:\n";
+	photLog() << "\n" << verts.size() << " Verts:\n";
 
 	int vertsPerLine = 4;
 	int vertIndexCounter = 0;
 
 	for (auto v : verts) {
 
-		MStreamUtils::stdOutStream() << vertIndexCounter++ << ": " << v << ", ";
+		photLog() << vertIndexCounter++ << ": " << v << ", ";
 
 		if (vertIndexCounter + 1 % vertsPerLine == 0)
-			MStreamUtils::stdOutStream() << "\n";
+			photLog() << "\n";
 	}
 
-	MStreamUtils::stdOutStream() << "\n\n" << faceCounts.size() << " Face Counts:\n";
+	photLog() << "\n\n" << faceCounts.size() << " Face Counts:\n";
 
 	int faceCountsPerLine = 20;
 	int fcIndexCounter = 0;
 
 	for (auto fc : faceCounts) {
 
-		MStreamUtils::stdOutStream() << "[" << fcIndexCounter++ << "]" << ": " << fc << ", ";
+		photLog() << "[" << fcIndexCounter++ << "]" << ": " << fc << ", ";
 
 		if (fcIndexCounter + 1 % faceCountsPerLine == 0)
-			MStreamUtils::stdOutStream() << "\n";
+			photLog() << "\n";
 	}
 
-	MStreamUtils::stdOutStream() << "\n\n" << faceConnects.size() << " Face Connects:\n";
+	photLog() << "\n\n" << faceConnects.size() << " Face Connects:\n";
 
 	int faceConnectsPerLine = 20;
 	int fccIndexCounter = 0;
 
 	for (auto fcc : faceConnects) {
 
-		MStreamUtils::stdOutStream() << "[" << fccIndexCounter++ << "]" << ": " << fcc << ", ";
+		photLog() << "[" << fccIndexCounter++ << "]" << ": " << fcc << ", ";
 
 		if (fccIndexCounter + 1 % faceConnectsPerLine == 0)
-			MStreamUtils::stdOutStream() << "\n";
+			photLog() << "\n";
 	}
 
-	MStreamUtils::stdOutStream() << "\n\n";
+	photLog() << "\n\n";
 }
\ No newline at end of file
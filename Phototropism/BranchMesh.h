@@ -71,7 +71,7 @@ public:
 	// Makes a ring of points (not vertices added to the mesh) that will have vectors added to them to create the next ring
 	// This is used when the next segment has a different radius than the last, but it is not a big enough difference to warrant creating a divider
 	// Typically this ring is a shrunken version of the top ring of vertices
-	std::vector<Point> BranchMesh::makeRingToAddTo(const double radiusDiff, const Point center, const double halfDividerWidth) const;
+	std::vector<Point> makeRingToAddTo(const double radiusDiff, const Point center, const double halfDividerWidth) const;
 
 	// Creates the next ring of vertices
 	std::vector<double> createNextRing(Segment *currentSeg, Segment *nextSeg, const std::vector<double> &preadjusts,
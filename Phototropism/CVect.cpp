@@ -4,17 +4,15 @@
 
 */
 
-#include <maya/MGlobal.h>
-#include <maya/MObject.h>
-
 #include "CVect.h"
+#include "PhotLog.h"
 #include "Point.h"
-#include "operators.h"
+#include "Operators.h"
 
 void CVect::resize(double newLength) {
 
 	if (mag == 0.)
-		MStreamUtils::stdOutStream() << "VECTOR LENGTH IS ZERO (in CVect::resize())\n";
+		photLog() << "VECTOR LENGTH IS ZERO (in CVect::resize())\n";
 
 	double normalizer = newLength / mag;
 	x *= normalizer;
@@ -26,7 +24,7 @@ void CVect::resize(double newLength) {
 CVect CVect::resized(double newLength) const {
 
 	if (mag == 0.)
-		MStreamUtils::stdOutStream() << "VECTOR LENGTH IS ZERO (in CVect::resized())\n";
+		photLog() << "VECTOR LENGTH IS ZERO (in CVect::resized())\n";
 
 	double normalizer = newLength / mag;
 
@@ -11,8 +11,7 @@ Created by \ on 9/26/20.
 #include <math.h>
 #include <iostream>
 
-#include <maya/MStreamUtils.h>
-
+#include "PhotLog.h"
 #include "Point.h"
 #include "SphAngles.h"
 
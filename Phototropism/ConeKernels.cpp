@@ -0,0 +1,339 @@
+/*
+	ConeKernels.cpp
+*/
+
+#include <cmath>
+
+#include "ConeKernels.h"
+
+// Only 64 bit x86 is treated as x86.  SSE2 is part of every x64 processor, so the SSE2 kernels need neither a target attribute
+// nor a check of the processor, and doubles are computed in SSE2 registers rather than on the x87 stack, which the kernels
+// rely on to give identical results.  32 bit builds use the scalar kernel (the plug-in itself is only built for x64)
+#if defined(_M_X64) || defined(__x86_64__)
+#define PHOT_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only allow AVX2 intrinsics in functions marked as targeting AVX2.  MSVC allows them anywhere
+#if defined(PHOT_X86) && (defined(__GNUC__) || defined(__clang__))
+#define PHOT_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PHOT_TARGET_AVX2
+#endif
+
+void applyConeScalar(double *lightX, double *lightY, double *lightZ, double *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange, double lightMag) {
+
+	for (int n = 0; n < count; ++n) {
+
+		double x = lightX[n] + coneLightX[n] * densityChange;
+		double y = lightY[n] + coneLightY[n] * densityChange;
+		double z = lightZ[n] + coneLightZ[n] * densityChange;
+		double normalizer = lightMag / std::sqrt(x*x + y*y + z*z);
+		lightX[n] = x * normalizer;
+		lightY[n] = y * normalizer;
+		lightZ[n] = z * normalizer;
+		blockage[n] += coneStrength[n] * densityChange;
+	}
+}
+
+void accumulateConeScalar(double *lightX, double *lightY, double *lightZ, double *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange, double lightMag) {
+
+	// Accumulating kernels share the ConeKernel signature, but never resize
+	(void)lightMag;
+
+	for (int n = 0; n < count; ++n) {
+
+		lightX[n] += coneLightX[n] * densityChange;
+		lightY[n] += coneLightY[n] * densityChange;
+		lightZ[n] += coneLightZ[n] * densityChange;
+		blockage[n] += coneStrength[n] * densityChange;
+	}
+}
+
+void accumulateConeFloatScalar(float *lightX, float *lightY, float *lightZ, float *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange) {
+
+	for (int n = 0; n < count; ++n) {
+
+		lightX[n] = float(lightX[n] + coneLightX[n] * densityChange);
+		lightY[n] = float(lightY[n] + coneLightY[n] * densityChange);
+		lightZ[n] = float(lightZ[n] + coneLightZ[n] * densityChange);
+		blockage[n] = float(blockage[n] + coneStrength[n] * densityChange);
+	}
+}
+
+#ifdef PHOT_X86
+
+void applyConeSSE2(double *lightX, double *lightY, double *lightZ, double *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange, double lightMag) {
+
+	__m128d dc = _mm_set1_pd(densityChange);
+	__m128d mag = _mm_set1_pd(lightMag);
+
+	int n = 0;
+	for (; n + 2 <= count; n += 2) {
+
+		__m128d x = _mm_add_pd(_mm_loadu_pd(lightX + n), _mm_mul_pd(_mm_loadu_pd(coneLightX + n), dc));
+		__m128d y = _mm_add_pd(_mm_loadu_pd(lightY + n), _mm_mul_pd(_mm_loadu_pd(coneLightY + n), dc));
+		__m128d z = _mm_add_pd(_mm_loadu_pd(lightZ + n), _mm_mul_pd(_mm_loadu_pd(coneLightZ + n), dc));
+		__m128d sqMag = _mm_add_pd(_mm_add_pd(_mm_mul_pd(x, x), _mm_mul_pd(y, y)), _mm_mul_pd(z, z));
+		__m128d normalizer = _mm_div_pd(mag, _mm_sqrt_pd(sqMag));
+		_mm_storeu_pd(lightX + n, _mm_mul_pd(x, normalizer));
+		_mm_storeu_pd(lightY + n, _mm_mul_pd(y, normalizer));
+		_mm_storeu_pd(lightZ + n, _mm_mul_pd(z, normalizer));
+		_mm_storeu_pd(blockage + n, _mm_add_pd(_mm_loadu_pd(blockage + n), _mm_mul_pd(_mm_loadu_pd(coneStrength + n), dc)));
+	}
+
+	applyConeScalar(lightX + n, lightY + n, lightZ + n, blockage + n, coneLightX + n, coneLightY + n, coneLightZ + n,
+		coneStrength + n, count - n, densityChange, lightMag);
+}
+
+PHOT_TARGET_AVX2
+void applyConeAVX2(double *lightX, double *lightY, double *lightZ, double *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange, double lightMag) {
+
+	__m256d dc = _mm256_set1_pd(densityChange);
+	__m256d mag = _mm256_set1_pd(lightMag);
+
+	// Multiplies and adds are kept separate (rather than fused) so that the results match the scalar kernel exactly
+	int n = 0;
+	for (; n + 4 <= count; n += 4) {
+
+		__m256d x = _mm256_add_pd(_mm256_loadu_pd(lightX + n), _mm256_mul_pd(_mm256_loadu_pd(coneLightX + n), dc));
+		__m256d y = _mm256_add_pd(_mm256_loadu_pd(lightY + n), _mm256_mul_pd(_mm256_loadu_pd(coneLightY + n), dc));
+		__m256d z = _mm256_add_pd(_mm256_loadu_pd(lightZ + n), _mm256_mul_pd(_mm256_loadu_pd(coneLightZ + n), dc));
+		__m256d sqMag = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y)), _mm256_mul_pd(z, z));
+		__m256d normalizer = _mm256_div_pd(mag, _mm256_sqrt_pd(sqMag));
+		_mm256_storeu_pd(lightX + n, _mm256_mul_pd(x, normalizer));
+		_mm256_storeu_pd(lightY + n, _mm256_mul_pd(y, normalizer));
+		_mm256_storeu_pd(lightZ + n, _mm256_mul_pd(z, normalizer));
+		_mm256_storeu_pd(blockage + n,
+			_mm256_add_pd(_mm256_loadu_pd(blockage + n), _mm256_mul_pd(_mm256_loadu_pd(coneStrength + n), dc)));
+	}
+
+	applyConeSSE2(lightX + n, lightY + n, lightZ + n, blockage + n, coneLightX + n, coneLightY + n, coneLightZ + n,
+		coneStrength + n, count - n, densityChange, lightMag);
+}
+
+void accumulateConeSSE2(double *lightX, double *lightY, double *lightZ, double *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange, double lightMag) {
+
+	__m128d dc = _mm_set1_pd(densityChange);
+
+	int n = 0;
+	for (; n + 2 <= count; n += 2) {
+
+		_mm_storeu_pd(lightX + n, _mm_add_pd(_mm_loadu_pd(lightX + n), _mm_mul_pd(_mm_loadu_pd(coneLightX + n), dc)));
+		_mm_storeu_pd(lightY + n, _mm_add_pd(_mm_loadu_pd(lightY + n), _mm_mul_pd(_mm_loadu_pd(coneLightY + n), dc)));
+		_mm_storeu_pd(lightZ + n, _mm_add_pd(_mm_loadu_pd(lightZ + n), _mm_mul_pd(_mm_loadu_pd(coneLightZ + n), dc)));
+		_mm_storeu_pd(blockage + n, _mm_add_pd(_mm_loadu_pd(blockage + n), _mm_mul_pd(_mm_loadu_pd(coneStrength + n), dc)));
+	}
+
+	accumulateConeScalar(lightX + n, lightY + n, lightZ + n, blockage + n, coneLightX + n, coneLightY + n, coneLightZ + n,
+		coneStrength + n, count - n, densityChange, lightMag);
+}
+
+PHOT_TARGET_AVX2
+void accumulateConeAVX2(double *lightX, double *lightY, double *lightZ, double *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange, double lightMag) {
+
+	__m256d dc = _mm256_set1_pd(densityChange);
+
+	int n = 0;
+	for (; n + 4 <= count; n += 4) {
+
+		_mm256_storeu_pd(lightX + n, _mm256_add_pd(_mm256_loadu_pd(lightX + n), _mm256_mul_pd(_mm256_loadu_pd(coneLightX + n), dc)));
+		_mm256_storeu_pd(lightY + n, _mm256_add_pd(_mm256_loadu_pd(lightY + n), _mm256_mul_pd(_mm256_loadu_pd(coneLightY + n), dc)));
+		_mm256_storeu_pd(lightZ + n, _mm256_add_pd(_mm256_loadu_pd(lightZ + n), _mm256_mul_pd(_mm256_loadu_pd(coneLightZ + n), dc)));
+		_mm256_storeu_pd(blockage + n,
+			_mm256_add_pd(_mm256_loadu_pd(blockage + n), _mm256_mul_pd(_mm256_loadu_pd(coneStrength + n), dc)));
+	}
+
+	accumulateConeSSE2(lightX + n, lightY + n, lightZ + n, blockage + n, coneLightX + n, coneLightY + n, coneLightZ + n,
+		coneStrength + n, count - n, densityChange, lightMag);
+}
+
+// Loads 2 floats as doubles, and stores 2 doubles as floats
+static __m128d loadFloatsSSE2(const float *values) {
+
+	return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(values))));
+}
+
+static void storeFloatsSSE2(float *values, __m128d sums) {
+
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(values), _mm_castps_si128(_mm_cvtpd_ps(sums)));
+}
+
+void accumulateConeFloatSSE2(float *lightX, float *lightY, float *lightZ, float *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange) {
+
+	__m128d dc = _mm_set1_pd(densityChange);
+
+	int n = 0;
+	for (; n + 2 <= count; n += 2) {
+
+		storeFloatsSSE2(lightX + n, _mm_add_pd(loadFloatsSSE2(lightX + n), _mm_mul_pd(_mm_loadu_pd(coneLightX + n), dc)));
+		storeFloatsSSE2(lightY + n, _mm_add_pd(loadFloatsSSE2(lightY + n), _mm_mul_pd(_mm_loadu_pd(coneLightY + n), dc)));
+		storeFloatsSSE2(lightZ + n, _mm_add_pd(loadFloatsSSE2(lightZ + n), _mm_mul_pd(_mm_loadu_pd(coneLightZ + n), dc)));
+		storeFloatsSSE2(blockage + n, _mm_add_pd(loadFloatsSSE2(blockage + n), _mm_mul_pd(_mm_loadu_pd(coneStrength + n), dc)));
+	}
+
+	accumulateConeFloatScalar(lightX + n, lightY + n, lightZ + n, blockage + n, coneLightX + n, coneLightY + n, coneLightZ + n,
+		coneStrength + n, count - n, densityChange);
+}
+
+PHOT_TARGET_AVX2
+void accumulateConeFloatAVX2(float *lightX, float *lightY, float *lightZ, float *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange) {
+
+	__m256d dc = _mm256_set1_pd(densityChange);
+
+	// Each float is widened to a double, summed, and rounded back, exactly as the scalar kernel does
+	int n = 0;
+	for (; n + 4 <= count; n += 4) {
+
+		_mm_storeu_ps(lightX + n, _mm256_cvtpd_ps(_mm256_add_pd(_mm256_cvtps_pd(_mm_loadu_ps(lightX + n)),
+			_mm256_mul_pd(_mm256_loadu_pd(coneLightX + n), dc))));
+		_mm_storeu_ps(lightY + n, _mm256_cvtpd_ps(_mm256_add_pd(_mm256_cvtps_pd(_mm_loadu_ps(lightY + n)),
+			_mm256_mul_pd(_mm256_loadu_pd(coneLightY + n), dc))));
+		_mm_storeu_ps(lightZ + n, _mm256_cvtpd_ps(_mm256_add_pd(_mm256_cvtps_pd(_mm_loadu_ps(lightZ + n)),
+			_mm256_mul_pd(_mm256_loadu_pd(coneLightZ + n), dc))));
+		_mm_storeu_ps(blockage + n, _mm256_cvtpd_ps(_mm256_add_pd(_mm256_cvtps_pd(_mm_loadu_ps(blockage + n)),
+			_mm256_mul_pd(_mm256_loadu_pd(coneStrength + n), dc))));
+	}
+
+	accumulateConeFloatSSE2(lightX + n, lightY + n, lightZ + n, blockage + n, coneLightX + n, coneLightY + n, coneLightZ + n,
+		coneStrength + n, count - n, densityChange);
+}
+
+static bool cpuSupportsAVX2() {
+
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	// The processor must support AVX and the OS must save the AVX registers (OSXSAVE and XCR0) before AVX2 can be used
+	__cpuid(info, 1);
+	bool osUsesXSave = (info[2] & (1 << 27)) != 0;
+	bool hasAVX = (info[2] & (1 << 28)) != 0;
+	if (!osUsesXSave || !hasAVX || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#else
+
+// Without x86 intrinsics, the vectorized kernels simply forward to the scalar one
+
+void applyConeSSE2(double *lightX, double *lightY, double *lightZ, double *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange, double lightMag) {
+
+	applyConeScalar(lightX, lightY, lightZ, blockage, coneLightX, coneLightY, coneLightZ, coneStrength, count, densityChange, lightMag);
+}
+
+void applyConeAVX2(double *lightX, double *lightY, double *lightZ, double *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange, double lightMag) {
+
+	applyConeScalar(lightX, lightY, lightZ, blockage, coneLightX, coneLightY, coneLightZ, coneStrength, count, densityChange, lightMag);
+}
+
+void accumulateConeSSE2(double *lightX, double *lightY, double *lightZ, double *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange, double lightMag) {
+
+	accumulateConeScalar(lightX, lightY, lightZ, blockage, coneLightX, coneLightY, coneLightZ, coneStrength, count, densityChange, lightMag);
+}
+
+void accumulateConeAVX2(double *lightX, double *lightY, double *lightZ, double *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange, double lightMag) {
+
+	accumulateConeScalar(lightX, lightY, lightZ, blockage, coneLightX, coneLightY, coneLightZ, coneStrength, count, densityChange, lightMag);
+}
+
+void accumulateConeFloatSSE2(float *lightX, float *lightY, float *lightZ, float *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange) {
+
+	accumulateConeFloatScalar(lightX, lightY, lightZ, blockage, coneLightX, coneLightY, coneLightZ, coneStrength, count, densityChange);
+}
+
+void accumulateConeFloatAVX2(float *lightX, float *lightY, float *lightZ, float *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange) {
+
+	accumulateConeFloatScalar(lightX, lightY, lightZ, blockage, coneLightX, coneLightY, coneLightZ, coneStrength, count, densityChange);
+}
+
+#endif
+
+ConeKernel selectConeKernel(bool resize) {
+
+#ifdef PHOT_X86
+	if (cpuSupportsAVX2())
+		return resize ? applyConeAVX2 : accumulateConeAVX2;
+
+	return resize ? applyConeSSE2 : accumulateConeSSE2;
+#else
+	return resize ? applyConeScalar : accumulateConeScalar;
+#endif
+}
+
+FloatConeKernel selectFloatConeKernel() {
+
+#ifdef PHOT_X86
+	if (cpuSupportsAVX2())
+		return accumulateConeFloatAVX2;
+
+	return accumulateConeFloatSSE2;
+#else
+	return accumulateConeFloatScalar;
+#endif
+}
+
+const char * coneKernelName(ConeKernel kernel) {
+
+#ifdef PHOT_X86
+	if (kernel == applyConeAVX2 || kernel == accumulateConeAVX2)
+		return "avx2";
+	else if (kernel == applyConeSSE2 || kernel == accumulateConeSSE2)
+		return "sse2";
+#endif
+
+	return "scalar";
+}
+
+const char * coneKernelName(FloatConeKernel kernel) {
+
+#ifdef PHOT_X86
+	if (kernel == accumulateConeFloatAVX2)
+		return "avx2";
+	else if (kernel == accumulateConeFloatSSE2)
+		return "sse2";
+#endif
+
+	return "scalar";
+}
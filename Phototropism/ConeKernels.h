@@ -0,0 +1,80 @@
+/*
+	ConeKernels.h
+
+	Kernels that apply a run of cone entries to a run of units (see BlockPointGrid::ConeRun)
+	Each kernel does, for n = 0 to count - 1:
+		light[n] += coneLight[n] * densityChange, then resizes light[n] to lightMag
+		blockage[n] += coneStrength[n] * densityChange
+
+	The accumulating kernels do the same but skip resizing, leaving the raw sum of all changes in light[n]
+
+	The float kernels accumulate into light and blockage stored as floats (see BlockPointGrid::setFloatStorage()).  Each sum is
+	computed in doubles, as in the other kernels, and rounded to a float when it is stored
+
+	The vectorized kernels perform the same operations in the same order as the scalar one, so all kernels give identical results
+*/
+
+#pragma once
+#ifndef ConeKernels_h
+#define ConeKernels_h
+
+typedef void (*ConeKernel)(double *lightX, double *lightY, double *lightZ, double *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange, double lightMag);
+
+// Works on any processor
+void applyConeScalar(double *lightX, double *lightY, double *lightZ, double *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange, double lightMag);
+
+// Processes 2 units at a time.  Only available on x64 processors
+void applyConeSSE2(double *lightX, double *lightY, double *lightZ, double *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange, double lightMag);
+
+// Processes 4 units at a time.  Only available on x64 processors that support AVX2
+void applyConeAVX2(double *lightX, double *lightY, double *lightZ, double *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange, double lightMag);
+
+void accumulateConeScalar(double *lightX, double *lightY, double *lightZ, double *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange, double lightMag);
+
+void accumulateConeSSE2(double *lightX, double *lightY, double *lightZ, double *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange, double lightMag);
+
+void accumulateConeAVX2(double *lightX, double *lightY, double *lightZ, double *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange, double lightMag);
+
+typedef void (*FloatConeKernel)(float *lightX, float *lightY, float *lightZ, float *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange);
+
+void accumulateConeFloatScalar(float *lightX, float *lightY, float *lightZ, float *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange);
+
+void accumulateConeFloatSSE2(float *lightX, float *lightY, float *lightZ, float *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange);
+
+void accumulateConeFloatAVX2(float *lightX, float *lightY, float *lightZ, float *blockage,
+	const double *coneLightX, const double *coneLightY, const double *coneLightZ, const double *coneStrength,
+	int count, double densityChange);
+
+// Returns the fastest kernel supported by the processor the program is running on
+// If resize is false, an accumulating kernel is returned
+ConeKernel selectConeKernel(bool resize = true);
+
+// Returns the fastest float kernel supported by the processor the program is running on
+FloatConeKernel selectFloatConeKernel();
+
+// The name of the kernel, e.g. "avx2"
+const char * coneKernelName(ConeKernel kernel);
+
+const char * coneKernelName(FloatConeKernel kernel);
+
+#endif /* ConeKernels_h */
@@ -5,7 +5,7 @@ Created by \ on 9/26/20.
 
 */
 
-#include "operators.h"
+#include "Operators.h"
 
 bool operator!=(const Point &lhs, const Point &rhs)
 {
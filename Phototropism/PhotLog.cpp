@@ -0,0 +1,11 @@
+/*
+	PhotLog.cpp
+*/
+
+#include "PhotLog.h"
+
+static std::ostream *logStream = &std::cout;
+
+std::ostream& photLog() { return *logStream; }
+
+void setPhotLogStream(std::ostream &os) { logStream = &os; }
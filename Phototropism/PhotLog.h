@@ -0,0 +1,22 @@
+/*
+	PhotLog.h
+
+	Status codes and message output for the simulation core (BlockPointGrid, BranchMesh, etc.), which does not depend on Maya
+	Messages go to std::cout until another stream is set.  The plug-in sends them to Maya's output when it is loaded
+*/
+
+#pragma once
+#ifndef PhotLog_h
+#define PhotLog_h
+
+#include <iostream>
+
+// Returned by core functions that can fail.  Any details of a failure are written to photLog()
+enum class PhotStatus { kSuccess, kFailure };
+
+// The stream that all core messages are written to
+std::ostream& photLog();
+
+void setPhotLogStream(std::ostream &os);
+
+#endif /* PhotLog_h */
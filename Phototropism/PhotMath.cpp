@@ -154,6 +154,20 @@ Point randPoint(double xMin, double xMax, double yMin, double yMax, double zMin,
 	return { randBetween(xMin, xMax), randBetween(yMin, yMax), randBetween(zMin, zMax) };
 }
 
+double randBetween(double mn, double mx, std::mt19937 &gen) {
+
+	return std::uniform_real_distribution<double>(mn, mx)(gen);
+}
+
+Point randPoint(double xMin, double xMax, double yMin, double yMax, double zMin, double zMax, std::mt19937 &gen) {
+
+	// Drawn one at a time, since the order in which function arguments are evaluated is unspecified
+	double x = randBetween(xMin, xMax, gen);
+	double y = randBetween(yMin, yMax, gen);
+	double z = randBetween(zMin, zMax, gen);
+	return { x, y, z };
+}
+
 double trunc4(double value) {
 
 	return std::trunc(value * 10000.) / 10000.;
@@ -10,8 +10,7 @@
 #include <iostream>
 #include <random>
 
-#include <maya/MStreamUtils.h>
-
+#include "PhotLog.h"
 #include "Point.h"
 #include "SphAngles.h"
 #include "CVect.h"
@@ -61,6 +60,11 @@ double randBetween(double mn, double mx);
 
 Point randPoint(double xMin, double xMax, double yMin, double yMax, double zMin, double zMax);
 
+// The same as above, but drawing from gen rather than rand(), so that a run can be repeated by seeding gen the same way
+double randBetween(double mn, double mx, std::mt19937 &gen);
+
+Point randPoint(double xMin, double xMax, double yMin, double yMax, double zMin, double zMax, std::mt19937 &gen);
+
 double trunc4(double value);
 
 #endif /* PhotMath_h */
@@ -8,7 +8,7 @@
 #include <iostream>
 #include <math.h>
 
-#include <maya/MStreamUtils.h>
+#include "PhotLog.h"
 
 struct Point
 {
@@ -33,7 +33,7 @@ struct Point
 
 		double mag = std::sqrt(x*x + y*y + z*z);
 		if (mag == 0.)
-			MStreamUtils::stdOutStream() << "POINT LENGTH IS ZERO (in Point::resize())\n";
+			photLog() << "POINT LENGTH IS ZERO (in Point::resize())\n";
 
 		double normalizer = newLength / mag;
 		x *= normalizer;
@@ -9,6 +9,7 @@
 #include <iostream>
 #include <stdlib.h>
 #include <string>
+#include <vector>
 
 #include <maya/MStreamUtils.h>
 #include <maya/MArgDatabase.h>
@@ -44,15 +45,19 @@ MStatus TestBPGCommand::doIt(const MArgList &argList) {
 	double clusterRange = (gridSize / 2.) - clusterRadius;
 	Point clusterPoint = randPoint(-clusterRange, clusterRange, clusterRadius, gridSize - clusterRadius, -clusterRange, clusterRange);
 	std::size_t totalBlockPoints = 50;
+	std::vector<Point> bpLocs;
 	for (int i = 0; i < totalBlockPoints; ++i) {
 
 		Point randP = randPoint(clusterPoint.x - clusterRadius, clusterPoint.x + clusterRadius, 
 								clusterPoint.y - clusterRadius, clusterPoint.y + clusterRadius,
 								clusterPoint.z - clusterRadius, clusterPoint.z + clusterRadius);
-		BlockPoint *dummyPtr;
-		bpg.addBlockPoint(randP, .7, dummyPtr);
+		bpLocs.push_back(randP);
 	}
 
+	// Adding the points together means each unit in the cluster updates the grid once
+	std::vector<BlockPoint*> dummyPtrs;
+	bpg.addBlockPoints(bpLocs, std::vector<double>(totalBlockPoints, .7), dummyPtrs);
+
 	bpg.displayGridBorder();
 	bpg.displayGrid();
 	bpg.displayBlockPoints();
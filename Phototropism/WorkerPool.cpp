@@ -0,0 +1,76 @@
+/*
+	WorkerPool.cpp
+*/
+
+#include <algorithm>
+
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(int threads) {
+
+	for (int t = 1; t < threads; ++t)
+		workers.push_back(std::thread(&WorkerPool::workerLoop, this, t - 1));
+}
+
+WorkerPool::~WorkerPool() {
+
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		stopping = true;
+	}
+
+	workReady.notify_all();
+
+	for (auto &t : workers)
+		t.join();
+}
+
+void WorkerPool::workerLoop(int index) {
+
+	std::uint64_t doneGeneration = 0;
+	std::unique_lock<std::mutex> lock(stateMutex);
+
+	while (true) {
+
+		workReady.wait(lock, [&]() { return stopping || generation != doneGeneration; });
+		if (stopping)
+			return;
+
+		doneGeneration = generation;
+		if (index >= joiningWorkers)
+			continue;
+
+		const std::function<void()> *current = work;
+		lock.unlock();
+		(*current)();
+		lock.lock();
+
+		if (--unfinishedWorkers == 0)
+			workDone.notify_one();
+	}
+}
+
+void WorkerPool::run(int threads, const std::function<void()> &work) {
+
+	std::unique_lock<std::mutex> running(runMutex, std::try_to_lock);
+	if (!running || threads <= 1 || workers.empty()) {
+
+		work();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		this->work = &work;
+		joiningWorkers = std::min(threads - 1, int(workers.size()));
+		unfinishedWorkers = joiningWorkers;
+		++generation;
+	}
+
+	workReady.notify_all();
+
+	work();
+
+	std::unique_lock<std::mutex> lock(stateMutex);
+	workDone.wait(lock, [&]() { return unfinishedWorkers == 0; });
+}
@@ -0,0 +1,63 @@
+/*
+	WorkerPool.h
+
+	A set of threads that are started once and then given work again and again, so that splitting work between threads does
+	not cost starting and joining threads each time.  BlockPointGrid keeps one for its thread count (see setThreadCount())
+*/
+
+#pragma once
+#ifndef WorkerPool_h
+#define WorkerPool_h
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool {
+
+	std::vector<std::thread> workers;
+
+	// Held by the thread that is running work on the pool, for as long as it does
+	std::mutex runMutex;
+
+	// Guards everything below
+	std::mutex stateMutex;
+	std::condition_variable workReady;
+	std::condition_variable workDone;
+
+	const std::function<void()> *work = nullptr;
+
+	// The number of workers that take part in the current work, and how many of them have not finished it
+	int joiningWorkers = 0;
+	int unfinishedWorkers = 0;
+
+	// Increased each time work is given, so workers can tell new work from work they have already done
+	std::uint64_t generation = 0;
+
+	bool stopping = false;
+
+	void workerLoop(int index);
+
+public:
+
+	// Starts threads - 1 workers.  The thread that calls run() is the last one
+	explicit WorkerPool(int threads);
+
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool &) = delete;
+
+	WorkerPool &operator=(const WorkerPool &) = delete;
+
+	int threadCount() const { return int(workers.size()) + 1; }
+
+	// Calls work() on up to threads threads at once, one of them the calling thread, and returns once every call has returned
+	// If another thread is already running work on the pool, work() is only called on the calling thread.  So work() must share
+	// itself out, e.g. by claiming items from an atomic counter, rather than depend on how many times it is called
+	void run(int threads, const std::function<void()> &work);
+};
+
+#endif /* WorkerPool_h */
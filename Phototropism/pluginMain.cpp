@@ -7,8 +7,10 @@
 //
 
 #include <maya/MFnPlugin.h>
+#include <maya/MStreamUtils.h>
 
 #include "TestBPGCommand.h"
+#include "PhotLog.h"
 
 MStatus initializePlugin( MObject obj )
 //
@@ -24,6 +26,9 @@ MStatus initializePlugin( MObject obj )
 	MStatus   status;
 	MFnPlugin plugin( obj, "", "2018", "Any");
 
+	// Send messages from the simulation core to Maya's output
+	setPhotLogStream(MStreamUtils::stdOutStream());
+
 	status = plugin.registerCommand("testBPG", TestBPGCommand::creator, TestBPGCommand::newSyntax);
 	CHECK_MSTATUS_AND_RETURN_IT(status);
 
@@ -46,5 +51,7 @@ MStatus uninitializePlugin( MObject obj )
 	status = plugin.deregisterCommand("testBPG");
 	CHECK_MSTATUS_AND_RETURN_IT(status);
 
+	setPhotLogStream(std::cout);
+
 	return status;
 }
@@ -0,0 +1,254 @@
+/*
+	ConeKernelBenchmark.cpp
+
+	Times each cone kernel (see ConeKernels.h) on runs of a typical length, and checks its results against the references below.
+	The resizing kernels are checked against the same steps BlockPointGrid::adjustGrid() performed before the kernels existed
+	(blockageVect.resized() added to the light direction, then Point::resize()), and the accumulating kernels against plain sums.
+	Every kernel of a family must also match that family's scalar kernel exactly.  The float kernels are checked against the
+	accumulating reference with each sum rounded to a float, and their largest difference from the unrounded sums is printed
+
+	Built as the coneKernelBenchmark target (see CMakeLists.txt).  Returns nonzero if any kernel gives wrong results
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ConeKernels.h"
+
+struct Units {
+
+	std::vector<double> x, y, z, blockage;
+
+	Units(int count, std::mt19937 &gen) : x(count), y(count), z(count), blockage(count) {
+
+		std::uniform_real_distribution<double> dist(-1., 1.);
+		for (int i = 0; i < count; ++i) {
+
+			x[i] = dist(gen);
+			y[i] = 2. + dist(gen);
+			z[i] = dist(gen);
+			blockage[i] = 0.;
+		}
+	}
+};
+
+static void applyConeReference(Units &u, const Units &cone, int count, double densityChange, double lightMag) {
+
+	for (int n = 0; n < count; ++n) {
+
+		double coneMag = std::sqrt(cone.x[n] * cone.x[n] + cone.y[n] * cone.y[n] + cone.z[n] * cone.z[n]);
+		double resizer = (coneMag * densityChange) / coneMag;
+		double x = u.x[n] + cone.x[n] * resizer;
+		double y = u.y[n] + cone.y[n] * resizer;
+		double z = u.z[n] + cone.z[n] * resizer;
+		double normalizer = lightMag / std::sqrt(x*x + y*y + z*z);
+		u.x[n] = x * normalizer;
+		u.y[n] = y * normalizer;
+		u.z[n] = z * normalizer;
+		u.blockage[n] += cone.blockage[n] * densityChange;
+	}
+}
+
+static void accumulateConeReference(Units &u, const Units &cone, int count, double densityChange, double lightMag) {
+
+	(void)lightMag;
+
+	for (int n = 0; n < count; ++n) {
+
+		u.x[n] = u.x[n] + cone.x[n] * densityChange;
+		u.y[n] = u.y[n] + cone.y[n] * densityChange;
+		u.z[n] = u.z[n] + cone.z[n] * densityChange;
+		u.blockage[n] += cone.blockage[n] * densityChange;
+	}
+}
+
+static double maxDifference(const Units &a, const Units &b) {
+
+	double diff = 0.;
+	for (std::size_t i = 0; i < a.x.size(); ++i) {
+
+		diff = std::max(diff, std::fabs(a.x[i] - b.x[i]));
+		diff = std::max(diff, std::fabs(a.y[i] - b.y[i]));
+		diff = std::max(diff, std::fabs(a.z[i] - b.z[i]));
+		diff = std::max(diff, std::fabs(a.blockage[i] - b.blockage[i]));
+	}
+
+	return diff;
+}
+
+static bool identical(const Units &a, const Units &b) {
+
+	return a.x == b.x && a.y == b.y && a.z == b.z && a.blockage == b.blockage;
+}
+
+struct Candidate { const char *name; ConeKernel kernel; };
+
+// Times the reference and each candidate over the same changes, and returns whether every candidate is within tolerance of the
+// reference and identical to the first candidate, which is the family's scalar kernel
+static bool checkKernels(const char *family, void (*reference)(Units&, const Units&, int, double, double),
+	const std::vector<Candidate> &candidates, const Units &start, const Units &cone, const std::vector<double> &densityChanges,
+	int runLength, int runs, double lightMag, double tolerance) {
+
+	const int count = runLength * runs;
+	const int repetitions = int(densityChanges.size());
+
+	std::printf("%s kernels\n", family);
+
+	Units expected = start;
+	auto refStart = std::chrono::steady_clock::now();
+	for (int r = 0; r < repetitions; ++r)
+		reference(expected, cone, count, densityChanges[r], lightMag);
+	double refSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - refStart).count();
+	std::printf("%-10s %10.3f ns/unit\n", "reference", refSeconds * 1e9 / (double(count) * repetitions));
+
+	Units scalarResult = start;
+	bool allPassed = true;
+
+	for (const auto &c : candidates) {
+
+		Units u = start;
+		auto t0 = std::chrono::steady_clock::now();
+		for (int r = 0; r < repetitions; ++r)
+			for (int run = 0; run < runs; ++run) {
+
+				int first = run * runLength;
+				c.kernel(&u.x[first], &u.y[first], &u.z[first], &u.blockage[first], &cone.x[first], &cone.y[first], &cone.z[first],
+					&cone.blockage[first], runLength, densityChanges[r], lightMag);
+			}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+		if (&c == &candidates.front())
+			scalarResult = u;
+
+		double diff = maxDifference(u, expected);
+		bool matchesScalar = identical(u, scalarResult);
+		bool passed = diff <= tolerance && matchesScalar;
+		allPassed = allPassed && passed;
+
+		std::printf("%-10s %10.3f ns/unit  speedup %5.2fx  max diff from reference %.3g  %s scalar  %s\n", c.name,
+			seconds * 1e9 / (double(count) * repetitions), refSeconds / seconds, diff,
+			matchesScalar ? "identical to" : "DIFFERS from", passed ? "ok" : "FAILED");
+	}
+
+	return allPassed;
+}
+
+struct FloatCandidate { const char *name; FloatConeKernel kernel; };
+
+// As checkKernels(), for kernels that accumulate into floats.  Each is compared with the accumulating reference run on floats
+static bool checkFloatKernels(const std::vector<FloatCandidate> &candidates, const Units &start, const Units &cone,
+	const std::vector<double> &densityChanges, int runLength, int runs) {
+
+	const int count = runLength * runs;
+	const int repetitions = int(densityChanges.size());
+
+	std::printf("float kernels\n");
+
+	std::vector<float> startX(start.x.begin(), start.x.end()), startY(start.y.begin(), start.y.end()),
+		startZ(start.z.begin(), start.z.end()), startBlockage(start.blockage.begin(), start.blockage.end());
+
+	// The same sums in doubles, from the same rounded starting values
+	Units exact = start;
+	exact.x.assign(startX.begin(), startX.end());
+	exact.y.assign(startY.begin(), startY.end());
+	exact.z.assign(startZ.begin(), startZ.end());
+	exact.blockage.assign(startBlockage.begin(), startBlockage.end());
+	for (int r = 0; r < repetitions; ++r)
+		accumulateConeReference(exact, cone, count, densityChanges[r], 0.);
+
+	std::vector<float> expectedX = startX, expectedY = startY, expectedZ = startZ, expectedBlockage = startBlockage;
+	for (int r = 0; r < repetitions; ++r) {
+
+		for (int n = 0; n < count; ++n) {
+
+			expectedX[n] = float(expectedX[n] + cone.x[n] * densityChanges[r]);
+			expectedY[n] = float(expectedY[n] + cone.y[n] * densityChanges[r]);
+			expectedZ[n] = float(expectedZ[n] + cone.z[n] * densityChanges[r]);
+			expectedBlockage[n] = float(expectedBlockage[n] + cone.blockage[n] * densityChanges[r]);
+		}
+	}
+
+	bool allPassed = true;
+
+	for (const auto &c : candidates) {
+
+		std::vector<float> x = startX, y = startY, z = startZ, blockage = startBlockage;
+		auto t0 = std::chrono::steady_clock::now();
+		for (int r = 0; r < repetitions; ++r)
+			for (int run = 0; run < runs; ++run) {
+
+				int first = run * runLength;
+				c.kernel(&x[first], &y[first], &z[first], &blockage[first], &cone.x[first], &cone.y[first], &cone.z[first],
+					&cone.blockage[first], runLength, densityChanges[r]);
+			}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+		double diff = 0.;
+		for (int n = 0; n < count; ++n) {
+
+			diff = std::max(diff, std::fabs(x[n] - exact.x[n]));
+			diff = std::max(diff, std::fabs(y[n] - exact.y[n]));
+			diff = std::max(diff, std::fabs(z[n] - exact.z[n]));
+			diff = std::max(diff, std::fabs(blockage[n] - exact.blockage[n]));
+		}
+
+		bool passed = x == expectedX && y == expectedY && z == expectedZ && blockage == expectedBlockage;
+		allPassed = allPassed && passed;
+
+		std::printf("%-10s %10.3f ns/unit  max diff from double sums %.3g  %s\n", c.name,
+			seconds * 1e9 / (double(count) * repetitions), diff, passed ? "ok" : "FAILED");
+	}
+
+	return allPassed;
+}
+
+int main() {
+
+	// A run is a column of the cone, so its length is at most the cone's diameter in units.  Lengths that are not a multiple
+	// of the vector width exercise the kernels' tails
+	const int runLength = 19;
+	const int runs = 4096;
+	const int count = runLength * runs;
+	const int repetitions = 200;
+	const double lightMag = 2.5;
+	const double tolerance = 1e-12;
+
+	std::mt19937 gen(20201026);
+	Units start(count, gen);
+	Units cone(count, gen);
+	for (auto &b : cone.blockage)
+		b = .5;
+
+	std::vector<double> densityChanges;
+	std::uniform_real_distribution<double> changeDist(-.7, .7);
+	for (int r = 0; r < repetitions; ++r)
+		densityChanges.push_back(changeDist(gen));
+
+	bool avx2 = std::string(coneKernelName(selectConeKernel())) == "avx2";
+
+	std::vector<Candidate> resizing = { { "scalar", applyConeScalar }, { "sse2", applyConeSSE2 } };
+	std::vector<Candidate> accumulating = { { "scalar", accumulateConeScalar }, { "sse2", accumulateConeSSE2 } };
+	std::vector<FloatCandidate> floats = { { "scalar", accumulateConeFloatScalar }, { "sse2", accumulateConeFloatSSE2 } };
+	if (avx2) {
+
+		resizing.push_back({ "avx2", applyConeAVX2 });
+		accumulating.push_back({ "avx2", accumulateConeAVX2 });
+		floats.push_back({ "avx2", accumulateConeFloatAVX2 });
+	}
+
+	bool allPassed = checkKernels("resizing", applyConeReference, resizing, start, cone, densityChanges, runLength, runs, lightMag,
+		tolerance);
+	allPassed = checkKernels("accumulating", accumulateConeReference, accumulating, start, cone, densityChanges, runLength, runs,
+		lightMag, tolerance) && allPassed;
+	allPassed = checkFloatKernels(floats, start, cone, densityChanges, runLength, runs) && allPassed;
+
+	std::printf("selected kernel: %s, accumulating: %s, float: %s\n", coneKernelName(selectConeKernel()),
+		coneKernelName(selectConeKernel(false)), coneKernelName(selectFloatConeKernel()));
+
+	return allPassed ? 0 : 1;
+}
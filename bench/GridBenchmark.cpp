@@ -0,0 +1,1206 @@
+/*
+	GridBenchmark.cpp
+
+	Times the main operations of the simulation core over a range of parameters:
+		construction of a BlockPointGrid (setIndexVectorsAndMaximums() and initiateGrid())
+		adding and moving BlockPoints, one at a time and in batches, with 1 or more threads, and recomputing the whole grid
+		adding BlockPoints in batches on a large grid with 1 to 32 threads, to show how batch updates scale
+		adding BlockPoints in a batch to a sparse grid of more than 2^31 units, checked against adding them one at a time
+		recomputing a grid whose upper half is full (a dense canopy), compared with adding its BlockPoints in one batch
+		changing intensity and coneRangeAngle on a grid with deferred normalization
+		adding BlockPoints to a grid that stores its light field in floats, on small grids and on a large one
+		adding BlockPoints to a grid with sparse storage, or with coarse levels for the far part of the cone
+		querying meristem directions with getDirectionAndBlockage() and getDirectionsAndBlockages(), and refreshing the query cache it reads
+		replaying an event log with replayEventLog(), refusing to replay it on a grid with different settings, and refusing to
+		change the settings of a grid while it logs
+		loading a snapshot with loadSnapshot(), compared with only reading the file, and rejecting snapshots whose header does not fit the file
+		building a branch mesh with BranchMesh::go() and calculateUVs()
+
+	Every case uses a fixed random seed, so runs are reproducible and can be compared between builds
+	Each case is run several times and the fastest run is reported
+	Cases that produce a grid that should match another check that it does.  If any check fails, gridBenchmark exits with 1
+	When the core is built with PHOT_GRID_STATS, the grid's stats for the last run of each case are written to stderr as JSON
+
+	Usage: gridBenchmark [--filter <text>] [--repetitions <n>] [--csv]
+		--filter       only run cases whose name contains the text
+		--repetitions  the number of runs per case (default 3)
+		--csv          print comma separated values instead of a table
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "BlockPointGrid.h"
+#include "BranchMesh.h"
+#include "Segment.h"
+
+namespace {
+
+	const unsigned int seed = 20201026;
+
+	struct GridParams {
+
+		double gridSize;
+		double unitSize;
+		double detectionRange;
+		double coneAngle;
+
+		std::string name() const {
+
+			char buf[128];
+			std::snprintf(buf, sizeof(buf), "units=%d range=%.2f angle=%.2f", int(gridSize / unitSize + .5), detectionRange, coneAngle);
+			return buf;
+		}
+
+		std::unique_ptr<BlockPointGrid> makeGrid(bool sparse = false) const {
+
+			return std::unique_ptr<BlockPointGrid>(new BlockPointGrid(gridSize, gridSize, gridSize, unitSize, detectionRange, coneAngle, .1,
+				sparse));
+		}
+	};
+
+	struct PointParams {
+
+		int count;
+
+		// 0. spreads points over the whole grid.  Otherwise, points are spread over clusters of this radius, 50 points per cluster
+		double clusterRadius;
+
+		std::string name() const {
+
+			char buf[64];
+			if (clusterRadius > 0.)
+				std::snprintf(buf, sizeof(buf), "points=%d clustered=%.2f", count, clusterRadius);
+			else
+				std::snprintf(buf, sizeof(buf), "points=%d uniform", count);
+			return buf;
+		}
+	};
+
+	// Random locations on the grid (the grid sits on y = 0 and is centered on x and z)
+	std::vector<Point> makeLocations(const GridParams &g, const PointParams &p, std::mt19937 &gen) {
+
+		double half = g.gridSize / 2. - .001;
+		std::uniform_real_distribution<double> xz(-half, half);
+		std::uniform_real_distribution<double> y(.001, g.gridSize - .001);
+
+		std::vector<Point> locs;
+		Point clusterCenter;
+		for (int i = 0; i < p.count; ++i) {
+
+			if (p.clusterRadius <= 0.) {
+
+				locs.push_back(Point(xz(gen), y(gen), xz(gen)));
+				continue;
+			}
+
+			double r = p.clusterRadius;
+			if (i % 50 == 0) {
+
+				std::uniform_real_distribution<double> cxz(-half + r, half - r);
+				std::uniform_real_distribution<double> cy(r, g.gridSize - r);
+				clusterCenter = Point(cxz(gen), cy(gen), cxz(gen));
+			}
+
+			std::uniform_real_distribution<double> offset(-r, r);
+			locs.push_back(Point(clusterCenter.x + offset(gen), clusterCenter.y + offset(gen), clusterCenter.z + offset(gen)));
+		}
+
+		return locs;
+	}
+
+	// Moves each location by a small random amount, staying on the grid
+	std::vector<Point> jitterLocations(const GridParams &g, const std::vector<Point> &locs, double amount, std::mt19937 &gen) {
+
+		double half = g.gridSize / 2. - .001;
+		std::uniform_real_distribution<double> offset(-amount, amount);
+
+		std::vector<Point> moved;
+		for (const auto &l : locs) {
+
+			moved.push_back(Point(std::max(-half, std::min(half, l.x + offset(gen))),
+				std::max(.001, std::min(g.gridSize - .001, l.y + offset(gen))),
+				std::max(-half, std::min(half, l.z + offset(gen)))));
+		}
+
+		return moved;
+	}
+
+	struct Options {
+
+		std::string filter;
+		int repetitions = 3;
+		bool csv = false;
+	};
+
+	// A benchmark case runs its setup, then returns the seconds taken by the part being measured
+	struct Case {
+
+		std::string name;
+		int operations;
+		std::function<double()> run;
+	};
+
+	double secondsSince(std::chrono::steady_clock::time_point start) {
+
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// The stats of the grid measured by the last run of a case.  They are only kept when the core is built with
+	// PHOT_GRID_STATS (see GridStats)
+	GridStats caseStats;
+
+	// Starts measuring an operation on bpg.  Its stats are reset, so they only count that operation
+	std::chrono::steady_clock::time_point startMeasuring(BlockPointGrid &bpg) {
+
+		bpg.resetStats();
+		return std::chrono::steady_clock::now();
+	}
+
+	// Ends measuring an operation on bpg, keeping its stats in caseStats
+	double secondsSince(std::chrono::steady_clock::time_point start, const BlockPointGrid &bpg) {
+
+		double seconds = secondsSince(start);
+		caseStats = bpg.getStats();
+		return seconds;
+	}
+
+	// Set by a case whose check failed.  The remaining cases still run
+	bool checksFailed = false;
+
+	void failCheck(const std::string &caseName, const std::string &problem) {
+
+		std::fprintf(stderr, "Error. %s: %s\n", caseName.c_str(), problem.c_str());
+		checksFailed = true;
+	}
+
+	// The number of changes growGrid() makes for count locations
+	int growthChanges(int count) {
+
+		return count + count + count / 2 + count / 10;
+	}
+
+	// Changes the grid the way growth does: adds a BlockPoint at each of locs in one batch, moves each of them a little one at a
+	// time, changes the density of half of them in one batch, then removes every tenth one at a time.  handles is filled with
+	// the added BlockPoints
+	void growGrid(const GridParams &g, BlockPointGrid &bpg, const std::vector<Point> &locs, std::mt19937 &gen,
+		std::vector<BlockPointHandle> &handles) {
+
+		bpg.addBlockPoints(locs, std::vector<double>(locs.size(), .7), handles);
+
+		std::vector<Point> newLocs = jitterLocations(g, locs, g.unitSize, gen);
+		for (std::size_t i = 0; i < handles.size(); ++i)
+			bpg.moveBlockPoint(handles[i], newLocs[i]);
+
+		std::vector<BlockPointHandle> thinned(handles.begin(), handles.begin() + handles.size() / 2);
+		bpg.setBlockPointDensities(thinned, std::vector<double>(thinned.size(), .3));
+
+		for (std::size_t i = 0; i + 10 <= handles.size(); i += 10)
+			bpg.removeBlockPoint(handles[i]);
+	}
+
+	// Whether two grids hold the same BlockPoints under handles, and give exactly the same query results at the center of every
+	// unit.  A unit's query result is computed from its light direction and blockage, so this compares every unit
+	bool gridsMatch(const GridParams &g, const BlockPointGrid &a, const BlockPointGrid &b, const std::vector<BlockPointHandle> &handles) {
+
+		if (a.blockPointCount() != b.blockPointCount())
+			return false;
+
+		for (const auto &handle : handles) {
+
+			const BlockPoint *bpA = a.getBlockPoint(handle);
+			const BlockPoint *bpB = b.getBlockPoint(handle);
+			if (!bpA || !bpB) {
+
+				if (bpA != bpB)
+					return false;
+				continue;
+			}
+
+			if (bpA->loc.x != bpB->loc.x || bpA->loc.y != bpB->loc.y || bpA->loc.z != bpB->loc.z || bpA->density != bpB->density)
+				return false;
+		}
+
+		int units = int(g.gridSize / g.unitSize + .5);
+		for (int x = 0; x < units; ++x) {
+			for (int y = 0; y < units; ++y) {
+				for (int z = 0; z < units; ++z) {
+
+					Point center(-g.gridSize / 2. + (x + .5) * g.unitSize, (y + .5) * g.unitSize, -g.gridSize / 2. + (z + .5) * g.unitSize);
+					CVect directionA(0., 1., 0.), directionB(0., 1., 0.);
+					double blockageA, blockageB;
+					a.getDirectionAndBlockage(center, directionA, blockageA);
+					b.getDirectionAndBlockage(center, directionB, blockageB);
+
+					if (directionA.getX() != directionB.getX() || directionA.getY() != directionB.getY() ||
+						directionA.getZ() != directionB.getZ() || blockageA != blockageB)
+						return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	// Whether two grids give query results within tolerance of each other at the center of every unit
+	bool gridsAreClose(const GridParams &g, const BlockPointGrid &a, const BlockPointGrid &b, double tolerance) {
+
+		int units = int(g.gridSize / g.unitSize + .5);
+		for (int x = 0; x < units; ++x) {
+			for (int y = 0; y < units; ++y) {
+				for (int z = 0; z < units; ++z) {
+
+					Point center(-g.gridSize / 2. + (x + .5) * g.unitSize, (y + .5) * g.unitSize, -g.gridSize / 2. + (z + .5) * g.unitSize);
+					CVect directionA(0., 1., 0.), directionB(0., 1., 0.);
+					double blockageA, blockageB;
+					a.getDirectionAndBlockage(center, directionA, blockageA);
+					b.getDirectionAndBlockage(center, directionB, blockageB);
+
+					if (std::fabs(directionA.getX() - directionB.getX()) > tolerance || std::fabs(directionA.getY() - directionB.getY()) > tolerance ||
+						std::fabs(directionA.getZ() - directionB.getZ()) > tolerance || std::fabs(blockageA - blockageB) > tolerance)
+						return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	void addGridCases(std::vector<Case> &cases) {
+
+		std::vector<GridParams> grids = {
+			{ 8.25, .25, 1.2, MM::PI / 4. },
+			{ 8.25, .25, 2.4, MM::PI / 4. },
+			{ 8.25, .25, 2.4, MM::PI / 3. },
+			{ 8.125, .125, 1.2, MM::PI / 4. },
+			{ 8.125, .125, 2.4, MM::PI / 4. },
+		};
+
+		std::vector<PointParams> pointSets = {
+			{ 1000, 0. },
+			{ 1000, .25 },
+			{ 10000, .25 },
+		};
+
+		for (const auto &g : grids) {
+
+			cases.push_back({ "construct " + g.name(), 1, [g]() {
+
+				auto start = std::chrono::steady_clock::now();
+				auto bpg = g.makeGrid();
+				return secondsSince(start);
+			} });
+
+			cases.push_back({ "construct sparse " + g.name(), 1, [g]() {
+
+				auto start = std::chrono::steady_clock::now();
+				auto bpg = g.makeGrid(true);
+				return secondsSince(start);
+			} });
+
+			for (const auto &p : pointSets) {
+
+				std::string params = g.name() + " " + p.name();
+
+				cases.push_back({ "addBlockPoint " + params, p.count, [g, p]() {
+
+					std::mt19937 gen(seed);
+					std::vector<Point> locs = makeLocations(g, p, gen);
+					auto bpg = g.makeGrid();
+
+					auto start = startMeasuring(*bpg);
+					for (const auto &l : locs) {
+
+						BlockPoint *bp;
+						bpg->addBlockPoint(l, .7, bp);
+					}
+					return secondsSince(start, *bpg);
+				} });
+
+				for (int threads : { 1, 2, 4, 8 }) {
+
+					cases.push_back({ "addBlockPoints threads=" + std::to_string(threads) + " " + params, p.count, [g, p, threads]() {
+
+						std::mt19937 gen(seed);
+						std::vector<Point> locs = makeLocations(g, p, gen);
+						auto bpg = g.makeGrid();
+						bpg->setThreadCount(threads);
+						std::vector<BlockPoint*> bps;
+
+						auto start = startMeasuring(*bpg);
+						bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+						return secondsSince(start, *bpg);
+					} });
+				}
+
+				cases.push_back({ "addBlockPoints deferred " + params, p.count, [g, p]() {
+
+					std::mt19937 gen(seed);
+					std::vector<Point> locs = makeLocations(g, p, gen);
+					auto bpg = g.makeGrid();
+					bpg->setDeferredNormalization(true);
+					std::vector<BlockPoint*> bps;
+
+					auto start = startMeasuring(*bpg);
+					bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+					return secondsSince(start, *bpg);
+				} });
+
+				// The same changes as the deferred case, with the light field in floats
+				cases.push_back({ "addBlockPoints float " + params, p.count, [g, p, params]() {
+
+					std::mt19937 gen(seed);
+					std::vector<Point> locs = makeLocations(g, p, gen);
+					auto bpg = g.makeGrid();
+					bpg->setFloatStorage(true);
+					std::vector<BlockPoint*> bps;
+
+					auto start = startMeasuring(*bpg);
+					bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+					double seconds = secondsSince(start, *bpg);
+
+					auto doubles = g.makeGrid();
+					doubles->setDeferredNormalization(true);
+					doubles->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+					if (!gridsAreClose(g, *bpg, *doubles, 1e-4))
+						failCheck("addBlockPoints float " + params, "the grid is not within 1e-4 of the same grid in doubles");
+					return seconds;
+				} });
+
+				for (int levels : { 1, 2 }) {
+
+					cases.push_back({ "addBlockPoints coarseLevels=" + std::to_string(levels) + " " + params, p.count, [g, p, levels]() {
+
+						std::mt19937 gen(seed);
+						std::vector<Point> locs = makeLocations(g, p, gen);
+						auto bpg = g.makeGrid();
+						bpg->setCoarseLevels(levels);
+						std::vector<BlockPoint*> bps;
+
+						auto start = startMeasuring(*bpg);
+						bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+						return secondsSince(start, *bpg);
+					} });
+				}
+
+				// Also reports the fraction of units the sparse grid had to allocate
+				auto reported = std::make_shared<bool>(false);
+				cases.push_back({ "addBlockPoints sparse " + params, p.count, [g, p, reported]() {
+
+					std::mt19937 gen(seed);
+					std::vector<Point> locs = makeLocations(g, p, gen);
+					auto bpg = g.makeGrid(true);
+					std::vector<BlockPoint*> bps;
+
+					auto start = startMeasuring(*bpg);
+					bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+					double seconds = secondsSince(start, *bpg);
+
+					double units = std::pow(g.gridSize / g.unitSize, 3.);
+					if (!*reported)
+						std::fprintf(stderr, "  sparse grid stores %.1f%% of units\n", 100. * bpg->storedUnitCount() / units);
+					*reported = true;
+					return seconds;
+				} });
+
+				cases.push_back({ "moveBlockPoint " + params, p.count, [g, p]() {
+
+					std::mt19937 gen(seed);
+					std::vector<Point> locs = makeLocations(g, p, gen);
+					std::vector<Point> newLocs = jitterLocations(g, locs, g.unitSize, gen);
+					auto bpg = g.makeGrid();
+					std::vector<BlockPoint*> bps;
+					bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+
+					auto start = startMeasuring(*bpg);
+					for (std::size_t i = 0; i < bps.size(); ++i)
+						bpg->moveBlockPoint(bps[i], newLocs[i]);
+					return secondsSince(start, *bpg);
+				} });
+
+				// Shift stencils need deferred normalization, so they are compared against it
+				for (bool stencils : { false, true }) {
+
+					std::string name = stencils ? "moveBlockPoint shiftStencils " : "moveBlockPoint deferred ";
+					cases.push_back({ name + params, p.count, [g, p, stencils]() {
+
+						std::mt19937 gen(seed);
+						std::vector<Point> locs = makeLocations(g, p, gen);
+						std::vector<Point> newLocs = jitterLocations(g, locs, g.unitSize, gen);
+						auto bpg = g.makeGrid();
+						bpg->setDeferredNormalization(true);
+						bpg->setShiftStencils(stencils);
+						std::vector<BlockPoint*> bps;
+						bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+
+						auto start = startMeasuring(*bpg);
+						for (std::size_t i = 0; i < bps.size(); ++i)
+							bpg->moveBlockPoint(bps[i], newLocs[i]);
+						return secondsSince(start, *bpg);
+					} });
+				}
+
+				cases.push_back({ "moveBlockPoints " + params, p.count, [g, p]() {
+
+					std::mt19937 gen(seed);
+					std::vector<Point> locs = makeLocations(g, p, gen);
+					std::vector<Point> newLocs = jitterLocations(g, locs, g.unitSize, gen);
+					auto bpg = g.makeGrid();
+					std::vector<BlockPoint*> bps;
+					bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+
+					auto start = startMeasuring(*bpg);
+					bpg->moveBlockPoints(bps, newLocs);
+					return secondsSince(start, *bpg);
+				} });
+
+				cases.push_back({ "removeBlockPoint " + params, p.count, [g, p]() {
+
+					std::mt19937 gen(seed);
+					std::vector<Point> locs = makeLocations(g, p, gen);
+					auto bpg = g.makeGrid();
+					std::vector<BlockPointHandle> handles;
+					bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), handles);
+
+					auto start = startMeasuring(*bpg);
+					for (const auto &handle : handles)
+						bpg->removeBlockPoint(handle);
+					return secondsSince(start, *bpg);
+				} });
+
+				cases.push_back({ "removeBlockPoints " + params, p.count, [g, p]() {
+
+					std::mt19937 gen(seed);
+					std::vector<Point> locs = makeLocations(g, p, gen);
+					auto bpg = g.makeGrid();
+					std::vector<BlockPointHandle> handles;
+					bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), handles);
+
+					auto start = startMeasuring(*bpg);
+					bpg->removeBlockPoints(handles);
+					return secondsSince(start, *bpg);
+				} });
+
+				for (bool sorted : { false, true }) {
+
+					std::string name = sorted ? "getDirectionsAndBlockages sorted " : "getDirectionsAndBlockages ";
+					cases.push_back({ name + params, p.count, [g, p, sorted]() {
+
+						std::mt19937 gen(seed);
+						std::vector<Point> locs = makeLocations(g, p, gen);
+						std::vector<Point> meristems = jitterLocations(g, locs, g.unitSize * 2., gen);
+						auto bpg = g.makeGrid();
+						std::vector<BlockPoint*> bps;
+						bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+						bpg->refreshQueryCache();
+
+						// A growth step reuses its result arrays, so they are already allocated
+						std::vector<CVect> directions;
+						std::vector<double> blockages;
+						bpg->getDirectionsAndBlockages(meristems, directions, blockages, sorted);
+
+						auto start = startMeasuring(*bpg);
+						bpg->getDirectionsAndBlockages(meristems, directions, blockages, sorted);
+						return secondsSince(start, *bpg);
+					} });
+				}
+
+				cases.push_back({ "recomputeGrid " + params, p.count, [g, p]() {
+
+					std::mt19937 gen(seed);
+					std::vector<Point> locs = makeLocations(g, p, gen);
+					auto bpg = g.makeGrid();
+					std::vector<BlockPoint*> bps;
+					bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+
+					auto start = startMeasuring(*bpg);
+					bpg->recomputeGrid();
+					return secondsSince(start, *bpg);
+				} });
+
+				// Parameter changes on a deferred grid, which are applied incrementally
+				cases.push_back({ "setIntensity deferred " + params, 1, [g, p]() {
+
+					std::mt19937 gen(seed);
+					std::vector<Point> locs = makeLocations(g, p, gen);
+					auto bpg = g.makeGrid();
+					bpg->setDeferredNormalization(true);
+					std::vector<BlockPoint*> bps;
+					bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+
+					auto start = startMeasuring(*bpg);
+					bpg->setIntensity(bpg->getIntensity() * 1.5);
+					return secondsSince(start, *bpg);
+				} });
+
+				cases.push_back({ "setConeRangeAngle deferred " + params, 1, [g, p]() {
+
+					std::mt19937 gen(seed);
+					std::vector<Point> locs = makeLocations(g, p, gen);
+					auto bpg = g.makeGrid();
+					bpg->setDeferredNormalization(true);
+					std::vector<BlockPoint*> bps;
+					bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+
+					auto start = startMeasuring(*bpg);
+					bpg->setConeRangeAngle(bpg->getConeRangeAngle() + .05);
+					return secondsSince(start, *bpg);
+				} });
+
+				cases.push_back({ "refreshQueryCache " + params, 1, [g, p]() {
+
+					std::mt19937 gen(seed);
+					std::vector<Point> locs = makeLocations(g, p, gen);
+					auto bpg = g.makeGrid();
+					std::vector<BlockPoint*> bps;
+					bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+
+					auto start = startMeasuring(*bpg);
+					bpg->refreshQueryCache();
+					return secondsSince(start, *bpg);
+				} });
+
+				// A sparse row's query cache is allocated by the first refresh after the row is, so this also times allocating it
+				// The refreshed sparse grid must answer queries as the dense one does
+				for (bool packed : { false, true }) {
+
+					std::string name = std::string("refreshQueryCache sparse ") + (packed ? "packed " : "") + params;
+					cases.push_back({ name, 1, [g, p, packed, name]() {
+
+						std::mt19937 gen(seed);
+						std::vector<Point> locs = makeLocations(g, p, gen);
+						std::vector<Point> meristems = jitterLocations(g, locs, g.unitSize * 2., gen);
+						auto dense = g.makeGrid();
+						auto bpg = g.makeGrid(true);
+						std::vector<BlockPoint*> bps;
+						dense->setPackedQueryCache(packed);
+						bpg->setPackedQueryCache(packed);
+						dense->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+						bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+						dense->refreshQueryCache();
+
+						auto start = startMeasuring(*bpg);
+						bpg->refreshQueryCache();
+						double seconds = secondsSince(start, *bpg);
+
+						CVect denseDirection(0., 1., 0.), direction(0., 1., 0.);
+						double denseBlockage = 0., blockage = 0.;
+						for (const auto &m : meristems) {
+
+							dense->getDirectionAndBlockage(m, denseDirection, denseBlockage);
+							bpg->getDirectionAndBlockage(m, direction, blockage);
+							if (blockage != denseBlockage || direction.getX() != denseDirection.getX() ||
+								direction.getY() != denseDirection.getY() || direction.getZ() != denseDirection.getZ()) {
+
+								failCheck(name, "the sparse grid's queries do not match the dense grid's");
+								break;
+							}
+						}
+
+						return seconds;
+					} });
+				}
+
+				for (int mode = 0; mode < 4; ++mode) {
+
+					bool interpolated = mode & 1;
+					bool packed = mode & 2;
+					std::string name = std::string("getDirectionAndBlockage ") + (interpolated ? "interpolated " : "") + (packed ? "packed " : "");
+					cases.push_back({ name + params, p.count, [g, p, interpolated, packed]() {
+
+						std::mt19937 gen(seed);
+						std::vector<Point> locs = makeLocations(g, p, gen);
+						std::vector<Point> meristems = jitterLocations(g, locs, g.unitSize * 2., gen);
+						auto bpg = g.makeGrid();
+						std::vector<BlockPoint*> bps;
+						bpg->setPackedQueryCache(packed);
+						bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+						bpg->refreshQueryCache();
+						bpg->setInterpolatedQueries(interpolated);
+
+						CVect direction(0., 1., 0.);
+						double blockage = 0., total = 0.;
+
+						auto start = startMeasuring(*bpg);
+						for (const auto &m : meristems) {
+
+							bpg->getDirectionAndBlockage(m, direction, blockage);
+							total += blockage;
+						}
+						double seconds = secondsSince(start, *bpg);
+
+						// Keeps the queries from being optimized away
+						if (total < 0.)
+							std::printf("negative blockage\n");
+						return seconds;
+					} });
+				}
+			}
+		}
+	}
+
+	// Adds BlockPoints spread over a large grid in one batch with more and more threads.  Each thread count is its own case, so
+	// comparing their times gives the speedup.  Also adds a batch to a sparse grid of more than 2^31 units
+	void addScalingCases(std::vector<Case> &cases) {
+
+		GridParams g = { 16.125, .125, 2.4, MM::PI / 4. };
+		PointParams p = { 100000, 0. };
+
+		for (int threads : { 1, 2, 4, 8, 16, 32 }) {
+
+			cases.push_back({ "addBlockPoints scaling threads=" + std::to_string(threads) + " " + g.name() + " " + p.name(), p.count,
+				[g, p, threads]() {
+
+				std::mt19937 gen(seed);
+				std::vector<Point> locs = makeLocations(g, p, gen);
+				auto bpg = g.makeGrid();
+				bpg->setThreadCount(threads);
+				std::vector<BlockPoint*> bps;
+
+				auto start = startMeasuring(*bpg);
+				bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+				return secondsSince(start, *bpg);
+			} });
+		}
+
+		// The grid is far larger than the caches, so storing the light field in floats rather than doubles shows here most
+		for (bool floats : { false, true }) {
+
+			std::string name = std::string("addBlockPoints large ") + (floats ? "float " : "deferred ") + g.name() + " " + p.name();
+
+			cases.push_back({ name, p.count, [g, p, floats]() {
+
+				std::mt19937 gen(seed);
+				std::vector<Point> locs = makeLocations(g, p, gen);
+				auto bpg = g.makeGrid();
+				bpg->setDeferredNormalization(true);
+				bpg->setFloatStorage(floats);
+				std::vector<BlockPoint*> bps;
+
+				auto start = startMeasuring(*bpg);
+				bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+				return secondsSince(start, *bpg);
+			} });
+		}
+
+		// A sparse grid with more units than an int can count.  Half of the points are in the planes of highest x, whose unit
+		// indices are all above 2^31.  The batch must leave the grid as adding the points one at a time does
+		GridParams huge = { 1301., 1., 4.8, MM::PI / 4. };
+		PointParams few = { 200, 0. };
+		std::string name = "addBlockPoints sparse huge " + huge.name() + " " + few.name();
+
+		cases.push_back({ name, few.count, [huge, few, name]() {
+
+			std::mt19937 gen(seed);
+			std::vector<Point> locs = makeLocations(huge, few, gen);
+			std::uniform_real_distribution<double> farX(huge.gridSize / 2. - 20., huge.gridSize / 2. - 1.);
+			for (int i = 0; i < few.count / 2; ++i)
+				locs[i].x = farX(gen);
+
+			auto single = huge.makeGrid(true);
+			BlockPoint *bp;
+			for (const auto &loc : locs)
+				single->addBlockPoint(loc, .7, bp);
+
+			auto bpg = huge.makeGrid(true);
+			std::vector<BlockPoint*> bps;
+
+			auto start = startMeasuring(*bpg);
+			bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+			double seconds = secondsSince(start, *bpg);
+
+			CVect singleDirection(0., 1., 0.), direction(0., 1., 0.);
+			double singleBlockage = 0., blockage = 0.;
+			for (const auto &loc : locs) {
+
+				single->getDirectionAndBlockage(loc, singleDirection, singleBlockage);
+				bpg->getDirectionAndBlockage(loc, direction, blockage);
+				if (std::abs(blockage - singleBlockage) > 1e-9 || std::abs(direction.getX() - singleDirection.getX()) > 1e-9 ||
+					std::abs(direction.getY() - singleDirection.getY()) > 1e-9 || std::abs(direction.getZ() - singleDirection.getZ()) > 1e-9) {
+
+					failCheck(name, "the batch does not match adding the BlockPoints one at a time");
+					break;
+				}
+			}
+
+			if (bpg->storedUnitCount() != single->storedUnitCount())
+				failCheck(name, "the batch stored different units than adding the BlockPoints one at a time");
+
+			return seconds;
+		} });
+	}
+
+	// A BlockPoint at the center of every unit in the upper half of the grid
+	std::vector<Point> canopyLocations(const GridParams &g) {
+
+		int units = int(g.gridSize / g.unitSize + .5);
+		std::vector<Point> locs;
+		for (int x = 0; x < units; ++x) {
+			for (int y = units / 2; y < units; ++y) {
+				for (int z = 0; z < units; ++z)
+					locs.push_back(Point(-g.gridSize / 2. + (x + .5) * g.unitSize, (y + .5) * g.unitSize, -g.gridSize / 2. + (z + .5) * g.unitSize));
+			}
+		}
+
+		return locs;
+	}
+
+	// Times recomputeGrid() on a dense canopy, which is convolved when that is estimated to be cheaper, and adding the same
+	// BlockPoints to a new grid in one batch, which applies each unit's cone once as recomputing otherwise does.  The
+	// recomputed grid must match the batch, exactly with exact accumulation and to within rounding otherwise, with the light
+	// field in doubles or in floats
+	void addCanopyCases(std::vector<Case> &cases) {
+
+		std::vector<GridParams> grids = {
+			{ 8.25, .25, 1.2, MM::PI / 4. },
+			{ 8.125, .125, 1.2, MM::PI / 4. },
+			{ 8.125, .125, 2.4, MM::PI / 4. },
+			{ 8.125, .125, 4.8, MM::PI / 4. },
+		};
+
+		for (const auto &g : grids) {
+
+			for (std::string mode : { "deferred", "exact", "float" }) {
+
+				std::string params = mode + " " + g.name();
+				int units = int(canopyLocations(g).size());
+
+				// Float sums are rounded at every change when adding, but only once when convolving
+				auto makeGrid = [g, mode]() {
+
+					auto bpg = g.makeGrid();
+					bpg->setDeferredNormalization(true);
+					bpg->setExactAccumulation(mode == "exact");
+					bpg->setFloatStorage(mode == "float");
+					return bpg;
+				};
+				double tolerance = mode == "float" ? 1e-4 : 1e-9;
+
+				cases.push_back({ "recomputeGrid canopy " + params, units, [g, mode, params, makeGrid, tolerance]() {
+
+					std::vector<Point> locs = canopyLocations(g);
+					auto bpg = makeGrid();
+					std::vector<BlockPoint*> bps;
+					bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+					auto batch = makeGrid();
+					batch->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+
+					auto start = startMeasuring(*bpg);
+					bpg->recomputeGrid();
+					double seconds = secondsSince(start, *bpg);
+
+					if (mode == "exact" ? !gridsMatch(g, *bpg, *batch, {}) : !gridsAreClose(g, *bpg, *batch, tolerance))
+						failCheck("recomputeGrid canopy " + params, "the recomputed grid does not match adding its BlockPoints in a batch");
+					return seconds;
+				} });
+
+				cases.push_back({ "addBlockPoints canopy " + params, units, [g, makeGrid]() {
+
+					std::vector<Point> locs = canopyLocations(g);
+					auto bpg = makeGrid();
+					std::vector<BlockPoint*> bps;
+
+					auto start = startMeasuring(*bpg);
+					bpg->addBlockPoints(locs, std::vector<double>(locs.size(), .7), bps);
+					return secondsSince(start, *bpg);
+				} });
+			}
+		}
+	}
+
+	// Logs growGrid() on one grid, then times replaying the log on a new grid and checks that it matches.  Replaying each change
+	// with the call that made it always matches.  Batched replays only match with exact accumulation.  Replaying on a grid with
+	// other settings must fail
+	void addReplayCases(std::vector<Case> &cases) {
+
+		std::vector<GridParams> grids = {
+			{ 8.25, .25, 1.2, MM::PI / 4. },
+			{ 8.25, .25, 2.4, MM::PI / 4. },
+		};
+
+		PointParams p = { 1000, .25 };
+		const char *eventLogPath = "gridBenchmark.events";
+
+		for (const auto &g : grids) {
+
+			for (bool batched : { false, true }) {
+
+				std::string name = std::string("replayEventLog ") + (batched ? "batched exact " : "") + g.name() + " " + p.name();
+				cases.push_back({ name, growthChanges(p.count), [g, p, batched, eventLogPath, name]() {
+
+					std::mt19937 gen(seed);
+					std::vector<Point> locs = makeLocations(g, p, gen);
+					auto logged = g.makeGrid();
+					logged->setExactAccumulation(batched);
+					std::vector<BlockPointHandle> handles;
+
+					if (logged->startEventLog(eventLogPath) != PhotStatus::kSuccess) {
+
+						failCheck(name, std::string("could not write ") + eventLogPath);
+						return 0.;
+					}
+
+					// The thread count may change while logging, since it does not change the result
+					logged->setThreadCount(4);
+					growGrid(g, *logged, locs, gen, handles);
+					logged->stopEventLog();
+
+					auto bpg = g.makeGrid();
+					bpg->setExactAccumulation(batched);
+
+					auto start = startMeasuring(*bpg);
+					PhotStatus status = bpg->replayEventLog(eventLogPath, batched);
+					double seconds = secondsSince(start, *bpg);
+
+					std::remove(eventLogPath);
+					if (status != PhotStatus::kSuccess || !gridsMatch(g, *logged, *bpg, handles))
+						failCheck(name, "the replayed grid does not match the logged one");
+					return seconds;
+				} });
+			}
+		}
+
+		// A log must not be replayed on a grid whose settings would make its changes differ, even when the grid is the same size
+		const GridParams &g = grids.front();
+		std::string name = "replayEventLog on a grid with different settings " + g.name();
+		cases.push_back({ name, 1, [g, p, eventLogPath, name]() {
+
+			std::mt19937 gen(seed);
+			std::vector<Point> locs = makeLocations(g, p, gen);
+			auto logged = g.makeGrid();
+			logged->setExactAccumulation(true);
+			std::vector<BlockPointHandle> handles;
+
+			if (logged->startEventLog(eventLogPath) != PhotStatus::kSuccess) {
+
+				failCheck(name, std::string("could not write ") + eventLogPath);
+				return 0.;
+			}
+
+			growGrid(g, *logged, locs, gen, handles);
+			logged->stopEventLog();
+
+			auto bpg = g.makeGrid();
+			bpg->setDeferredNormalization(true);
+
+			auto start = startMeasuring(*bpg);
+			PhotStatus status = bpg->replayEventLog(eventLogPath);
+			double seconds = secondsSince(start, *bpg);
+
+			std::remove(eventLogPath);
+			if (status != PhotStatus::kFailure || bpg->blockPointCount() != 0)
+				failCheck(name, "the log was replayed");
+			return seconds;
+		} });
+
+		// Nor may the logged grid's settings change while it logs, since the header would no longer describe its changes
+		name = "setShiftStencils while logging events " + g.name();
+		cases.push_back({ name, 1, [g, p, eventLogPath, name]() {
+
+			std::mt19937 gen(seed);
+			std::vector<Point> locs = makeLocations(g, p, gen);
+			auto logged = g.makeGrid();
+			logged->setDeferredNormalization(true);
+			std::vector<BlockPointHandle> handles;
+
+			if (logged->startEventLog(eventLogPath) != PhotStatus::kSuccess) {
+
+				failCheck(name, std::string("could not write ") + eventLogPath);
+				return 0.;
+			}
+
+			growGrid(g, *logged, locs, gen, handles);
+
+			auto start = startMeasuring(*logged);
+			PhotStatus status = logged->setShiftStencils(true);
+			double seconds = secondsSince(start, *logged);
+
+			// Moves that would use the stencils had they been turned on
+			std::vector<Point> newLocs = jitterLocations(g, locs, g.unitSize, gen);
+			for (std::size_t i = 0; i < handles.size(); ++i) {
+
+				if (logged->getBlockPoint(handles[i]))
+					logged->moveBlockPoint(handles[i], newLocs[i]);
+			}
+			logged->stopEventLog();
+
+			auto bpg = g.makeGrid();
+			bpg->setDeferredNormalization(true);
+			PhotStatus replayed = bpg->replayEventLog(eventLogPath);
+
+			std::remove(eventLogPath);
+			if (status != PhotStatus::kFailure || logged->usesShiftStencils())
+				failCheck(name, "the setting was changed");
+			else if (replayed != PhotStatus::kSuccess || !gridsMatch(g, *logged, *bpg, handles))
+				failCheck(name, "the replayed grid does not match the logged one");
+			return seconds;
+		} });
+	}
+
+	// Grows a grid with growGrid(), saves it, and times loading it.  The saved and loaded grids are then both grown again the
+	// same way, and must still match.  Dense and sparse storage, coarse levels and float storage each keep different unit data,
+	// so each is checked.  Reading the file into memory is timed too, for comparison
+	void addSnapshotCases(std::vector<Case> &cases) {
+
+		std::vector<GridParams> grids = {
+			{ 8.25, .25, 2.4, MM::PI / 4. },
+			{ 8.125, .125, 2.4, MM::PI / 4. },
+		};
+
+		PointParams p = { 1000, .25 };
+		const char *snapshotPath = "gridBenchmark.snapshot";
+
+		for (const auto &g : grids) {
+
+			std::string params = g.name() + " " + p.name();
+
+			for (int mode = 0; mode < 4; ++mode) {
+
+				bool sparse = mode == 1;
+				int coarseLevels = mode == 2 ? 2 : 0;
+				bool floats = mode == 3;
+				std::string name = std::string("loadSnapshot ") + (sparse ? "sparse " : "") + (coarseLevels ? "coarseLevels=2 " : "") +
+					(floats ? "float " : "") + params;
+
+				cases.push_back({ name, 1, [g, p, sparse, coarseLevels, floats, snapshotPath, name]() {
+
+					std::mt19937 gen(seed);
+					std::vector<Point> locs = makeLocations(g, p, gen);
+					auto saved = g.makeGrid(sparse);
+					saved->setCoarseLevels(coarseLevels);
+					saved->setFloatStorage(floats);
+					std::vector<BlockPointHandle> handles;
+					growGrid(g, *saved, locs, gen, handles);
+
+					if (saved->saveSnapshot(snapshotPath) != PhotStatus::kSuccess) {
+
+						failCheck(name, std::string("could not write ") + snapshotPath);
+						return 0.;
+					}
+
+					std::unique_ptr<BlockPointGrid> bpg;
+					auto start = std::chrono::steady_clock::now();
+					PhotStatus status = BlockPointGrid::loadSnapshot(snapshotPath, bpg);
+					double seconds = secondsSince(start);
+
+					std::remove(snapshotPath);
+					if (status != PhotStatus::kSuccess) {
+
+						failCheck(name, "the snapshot could not be loaded");
+						return seconds;
+					}
+
+					if (!gridsMatch(g, *saved, *bpg, handles)) {
+
+						failCheck(name, "the loaded grid does not match the saved one");
+						return seconds;
+					}
+
+					// Both grids continue from the same state with the same changes
+					std::vector<Point> moreLocs = makeLocations(g, p, gen);
+					std::mt19937 savedGen = gen;
+					std::vector<BlockPointHandle> savedHandles, loadedHandles;
+					growGrid(g, *saved, moreLocs, savedGen, savedHandles);
+					growGrid(g, *bpg, moreLocs, gen, loadedHandles);
+
+					handles.insert(handles.end(), savedHandles.begin(), savedHandles.end());
+					if (savedHandles != loadedHandles || !gridsMatch(g, *saved, *bpg, handles))
+						failCheck(name, "the loaded grid no longer matches the saved one after both were changed");
+					return seconds;
+				} });
+			}
+
+			cases.push_back({ "read snapshot file " + params, 1, [g, p, snapshotPath, params]() {
+
+				std::mt19937 gen(seed);
+				std::vector<Point> locs = makeLocations(g, p, gen);
+				auto saved = g.makeGrid();
+				std::vector<BlockPointHandle> handles;
+				growGrid(g, *saved, locs, gen, handles);
+
+				if (saved->saveSnapshot(snapshotPath) != PhotStatus::kSuccess) {
+
+					failCheck("read snapshot file " + params, std::string("could not write ") + snapshotPath);
+					return 0.;
+				}
+
+				auto start = std::chrono::steady_clock::now();
+				std::ifstream in(snapshotPath, std::ios::binary | std::ios::ate);
+				std::vector<char> bytes(std::size_t(in.tellg()));
+				in.seekg(0);
+				in.read(bytes.data(), std::streamsize(bytes.size()));
+				double seconds = secondsSince(start);
+
+				std::remove(snapshotPath);
+				return seconds;
+			} });
+		}
+
+		// A snapshot whose header asks for more units or slots than the file holds must fail to load, without allocating them
+		// first.  The slot count follows the header and the five unit arrays of a dense grid without coarse levels
+		const GridParams &g = grids.front();
+		int units = int(g.gridSize / g.unitSize + .5);
+		std::size_t slotsOffset = 71 + std::size_t(5) * sizeof(double) * units * units * units;
+		for (std::size_t offset : { std::size_t(16), slotsOffset }) {
+
+			std::string name = std::string("loadSnapshot with too many ") + (offset == 16 ? "units " : "slots ") + g.name();
+
+			cases.push_back({ name, 1, [g, p, offset, snapshotPath, name]() {
+
+				std::mt19937 gen(seed);
+				std::vector<Point> locs = makeLocations(g, p, gen);
+				auto saved = g.makeGrid();
+				std::vector<BlockPointHandle> handles;
+				growGrid(g, *saved, locs, gen, handles);
+
+				if (saved->saveSnapshot(snapshotPath) != PhotStatus::kSuccess) {
+
+					failCheck(name, std::string("could not write ") + snapshotPath);
+					return 0.;
+				}
+
+				{
+					std::fstream file(snapshotPath, std::ios::binary | std::ios::in | std::ios::out);
+					const std::int32_t huge[3] = { 0x7fffffff, 0x7fffffff, 0x7fffffff };
+					file.seekp(std::streamoff(offset));
+					file.write(reinterpret_cast<const char*>(huge), offset == 16 ? sizeof(huge) : sizeof(huge[0]));
+				}
+
+				std::unique_ptr<BlockPointGrid> bpg;
+				auto start = std::chrono::steady_clock::now();
+				PhotStatus status = BlockPointGrid::loadSnapshot(snapshotPath, bpg);
+				double seconds = secondsSince(start);
+
+				std::remove(snapshotPath);
+				if (status != PhotStatus::kFailure || bpg)
+					failCheck(name, "the snapshot was loaded");
+				return seconds;
+			} });
+		}
+	}
+
+	void addMeshCases(std::vector<Case> &cases) {
+
+		for (int segments : { 100, 1000 }) {
+
+			for (int sides : { 2, 6, 12 }) {
+
+				std::string name = "BranchMesh segments=" + std::to_string(segments) + " sides=" + std::to_string(sides);
+
+				cases.push_back({ name, segments, [segments, sides]() {
+
+					// A single gently curving branch
+					std::mt19937 gen(seed);
+					std::uniform_real_distribution<double> bend(-.15, .15);
+					Meristem meri(.01, sides);
+					std::vector<Segment> segs;
+					segs.reserve(segments);
+
+					Point start(0., 0., 0.);
+					CVect vect(0., .1, 0.);
+					double radius = .1;
+					for (int i = 0; i < segments; ++i) {
+
+						segs.push_back(Segment(vect, start, radius, &meri));
+						if (i > 0)
+							segs[i - 1].addSegAbove(&segs[i]);
+
+						start = start + vect;
+						vect = CVect(vect.getX() + bend(gen) * .1, vect.getY(), vect.getZ() + bend(gen) * .1).resized(.1);
+						radius *= .999;
+					}
+
+					auto t0 = std::chrono::steady_clock::now();
+					BranchMesh bm(&segs[0], sides);
+					std::queue<Segment*> firstSegsOfBMeshes;
+					bm.go(&segs[0], std::vector<double>(sides, 0.), firstSegsOfBMeshes);
+					bm.calculateUVs();
+					return secondsSince(t0);
+				} });
+			}
+		}
+	}
+
+	Options parseOptions(int argc, char **argv) {
+
+		Options options;
+
+		for (int i = 1; i < argc; ++i) {
+
+			if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+				options.filter = argv[++i];
+			else if (std::strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc)
+				options.repetitions = std::max(1, std::atoi(argv[++i]));
+			else if (std::strcmp(argv[i], "--csv") == 0)
+				options.csv = true;
+			else {
+
+				std::fprintf(stderr, "Usage: %s [--filter <text>] [--repetitions <n>] [--csv]\n", argv[0]);
+				std::exit(1);
+			}
+		}
+
+		return options;
+	}
+}
+
+int main(int argc, char **argv) {
+
+	Options options = parseOptions(argc, argv);
+
+	std::vector<Case> cases;
+	addGridCases(cases);
+	addScalingCases(cases);
+	addCanopyCases(cases);
+	addReplayCases(cases);
+	addSnapshotCases(cases);
+	addMeshCases(cases);
+
+	if (options.csv)
+		std::printf("case,operations,best ms,ns per operation\n");
+
+	for (const auto &c : cases) {
+
+		if (!options.filter.empty() && c.name.find(options.filter) == std::string::npos)
+			continue;
+
+		caseStats = GridStats();
+
+		double best = 1e300;
+		for (int r = 0; r < options.repetitions; ++r)
+			best = std::min(best, c.run());
+
+		double nsPerOp = best * 1e9 / c.operations;
+
+		if (options.csv)
+			std::printf("\"%s\",%d,%.4f,%.1f\n", c.name.c_str(), c.operations, best * 1e3, nsPerOp);
+		else
+			std::printf("%-90s %12.3f ms %14.1f ns/op\n", c.name.c_str(), best * 1e3, nsPerOp);
+
+#ifdef PHOT_GRID_STATS
+		// The stats of the last run go to stderr, so they do not break up the table or the CSV
+		if (caseStats.collected) {
+
+			std::ostringstream stats;
+			caseStats.writeJSON(stats);
+			std::fprintf(stderr, "  stats of %s:\n%s", c.name.c_str(), stats.str().c_str());
+		}
+#endif
+
+		std::fflush(stdout);
+	}
+
+	return checksFailed ? 1 : 0;
+}